@@ -0,0 +1,263 @@
+// Timings for the BezierCurve module, no window or GL context needed.
+//
+// Each line of output is one (function, degree, samples) case with the
+// min, median and 99th percentile cost per output sample over the runs,
+// as CSV by default or as one JSON object per line with --json. Without
+// --runs the run count shrinks on the big cases, down to 5; with it every
+// case runs exactly N times.
+//
+//   avgl_bench_curves [--json] [--runs N] [--max-samples N]
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm.hpp>
+
+#include "../src/BezierCurve.hpp"
+#include "../src/BezierEvaluator.hpp"
+#include "../src/BezierKernel.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Results are summed in here so the compiler cannot drop the work
+static volatile double g_Sink = 0.0;
+
+struct BenchResult
+{
+    double minimum;
+    double median;
+    double p99;
+};
+
+// Control points on a loose spiral, the values do not change the cost
+template <class T>
+vector<T> make_control_points(int count);
+
+template <>
+vector<vec2> make_control_points<vec2>(int count)
+{
+    vector<vec2> b(count);
+    for (int i = 0; i < count; ++i)
+        b[i] = vec2(cos(i * 0.7f), sin(i * 0.7f)) * float(10 + i);
+    return b;
+}
+
+template <>
+vector<vec3> make_control_points<vec3>(int count)
+{
+    vector<vec3> b(count);
+    for (int i = 0; i < count; ++i)
+        b[i] = vec3(cos(i * 0.7f) * (10 + i), float(i % 5), sin(i * 0.7f) * (10 + i));
+    return b;
+}
+
+// Bezier3D as it was before BezierEvaluator, a pow() based Bernstein
+// weight per control point and sample, kept as the baseline of the speedups
+vector<vec3> baseline_bezier3D(BezierCurve & curve, vector<vec3> b, int cpts)
+{
+    int icount;
+    double step, t;
+    vector<vec3> p(cpts);
+
+    icount = 0;
+    t = 0;
+    step = (double)1.0 / (cpts - 1);
+
+    for (int i1 = 0; i1 != cpts; i1++)
+    {
+        if ((1.0 - t) < 5e-6)
+            t = 1.0;
+        p[icount] = vec3(0.0, 0.0, 0.0);
+        for (unsigned int jcount = 0; jcount != b.size(); ++jcount)
+        {
+            float basis = curve.Bernstein(b.size() - 1, jcount, t);
+            p[icount] += basis * b[jcount];
+        }
+
+        ++ icount;
+        t += step;
+    }
+
+    return p;
+}
+
+template <class T>
+void consume(const vector<T> & p)
+{
+    if (!p.empty())
+        g_Sink = g_Sink + p.back().x + p[p.size() / 2].y;
+}
+
+// Runs f once to warm up, then runs times, and returns ns per sample
+template <class F>
+BenchResult measure(F f, int samples, int runs)
+{
+    f();
+
+    vector<double> times(runs);
+    for (int r = 0; r < runs; ++r)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        f();
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        times[r] = chrono::duration<double, nano>(end - start).count() / samples;
+    }
+
+    sort(times.begin(), times.end());
+    BenchResult result;
+    result.minimum = times.front();
+    result.median = times[runs / 2];
+    result.p99 = times[std::min(runs - 1, int(runs * 0.99))];
+    return result;
+}
+
+void print_result(bool json, const char * name, int degree, int samples, int runs, const BenchResult & result)
+{
+    if (json)
+        printf("{\"function\":\"%s\",\"degree\":%d,\"samples\":%d,\"runs\":%d,\"min_ns\":%.3f,\"median_ns\":%.3f,\"p99_ns\":%.3f}\n",
+               name, degree, samples, runs, result.minimum, result.median, result.p99);
+    else
+        printf("%s,%d,%d,%d,%.3f,%.3f,%.3f\n", name, degree, samples, runs, result.minimum, result.median, result.p99);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    int maxRuns = 50;
+    bool fixedRuns = false;
+    int maxSamples = 100000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+        {
+            maxRuns = std::max(1, atoi(argv[++i]));
+            fixedRuns = true;
+        }
+        else if (!strcmp(argv[i], "--max-samples") && i + 1 < argc)
+            maxSamples = std::max(1, atoi(argv[++i]));
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--json] [--runs N] [--max-samples N]" << endl;
+            return 1;
+        }
+    }
+
+    const int degrees[] = { 3, 4, 6, 7, 8, 12, 16, 24, 32 };
+    const int sampleCounts[] = { 100, 1000, 10000, 100000 };
+
+    if (!json)
+        printf("function,degree,samples,runs,min_ns,median_ns,p99_ns\n");
+
+    BezierCurve curve;
+
+    for (unsigned int d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d)
+    {
+        int degree = degrees[d];
+        vector<vec2> b2 = make_control_points<vec2>(degree + 1);
+        vector<vec3> b3 = make_control_points<vec3>(degree + 1);
+
+        for (unsigned int s = 0; s < sizeof(sampleCounts) / sizeof(sampleCounts[0]); ++s)
+        {
+            int samples = sampleCounts[s];
+            if (samples > maxSamples)
+                continue;
+
+            // Fewer runs on the big cases keeps the whole sweep under a minute
+            int runs = fixedRuns ? maxRuns : std::max(5, std::min(maxRuns, 2000000 / (samples * (degree + 1))));
+
+            // The whole basis at each t, which is what a curve sample needs
+            BenchResult bernstein = measure([&]() {
+                double sum = 0.0;
+                double step = 1.0 / (samples - 1);
+                for (int k = 0; k < samples; ++k)
+                    for (int i = 0; i <= degree; ++i)
+                        sum += curve.Bernstein(degree, i, k * step);
+                g_Sink = g_Sink + sum;
+            }, samples, runs);
+            print_result(json, "Bernstein", degree, samples, runs, bernstein);
+
+            BenchResult bernsteinStable = measure([&]() {
+                double sum = 0.0;
+                double step = 1.0 / (samples - 1);
+                for (int k = 0; k < samples; ++k)
+                    for (int i = 0; i <= degree; ++i)
+                    {
+                        double value;
+                        if (BezierCurve::BernsteinStable(degree, i, k * step, value) == BEZIER_OK)
+                            sum += value;
+                    }
+                g_Sink = g_Sink + sum;
+            }, samples, runs);
+            print_result(json, "BernsteinStable", degree, samples, runs, bernsteinStable);
+
+            vector<double> row(degree + 1);
+            BenchResult bernsteinRow = measure([&]() {
+                double sum = 0.0;
+                double step = 1.0 / (samples - 1);
+                for (int k = 0; k < samples; ++k)
+                    if (BezierCurve::BernsteinRow(degree, k * step, &row[0]) == BEZIER_OK)
+                        sum += row[degree / 2];
+                g_Sink = g_Sink + sum;
+            }, samples, runs);
+            print_result(json, "BernsteinRow", degree, samples, runs, bernsteinRow);
+
+            BenchResult bezier2D = measure([&]() {
+                consume(curve.Bezier2D(b2, samples));
+            }, samples, runs);
+            print_result(json, "Bezier2D", degree, samples, runs, bezier2D);
+
+            BenchResult baseline3D = measure([&]() {
+                consume(baseline_bezier3D(curve, b3, samples));
+            }, samples, runs);
+            print_result(json, "Bezier3DBaseline", degree, samples, runs, baseline3D);
+
+            BenchResult bezier3D = measure([&]() {
+                consume(curve.Bezier3D(b3, samples));
+            }, samples, runs);
+            print_result(json, "Bezier3D", degree, samples, runs, bezier3D);
+
+            // The same curve through the runtime Horner evaluator and, up to
+            // BEZIER_KERNEL_MAX_DEGREE, through the unrolled kernel
+            vector<vec3> out3(samples);
+            BenchResult horner3D = measure([&]() {
+                BezierEvaluator<vec3>(b3).evaluateRange(0.0, 1.0, samples, out3.begin());
+                consume(out3);
+            }, samples, runs);
+            print_result(json, "Horner3D", degree, samples, runs, horner3D);
+
+            if (degree <= BEZIER_KERNEL_MAX_DEGREE)
+            {
+                BenchResult kernel3D = measure([&]() {
+                    EvaluateBezierRange<3, float>(&b3[0], degree + 1, 0.0, 1.0, samples, out3.begin());
+                    consume(out3);
+                }, samples, runs);
+                print_result(json, "Kernel3D", degree, samples, runs, kernel3D);
+            }
+
+            BenchResult bezier3DTable = measure([&]() {
+                consume(curve.Bezier3DTable(b3, samples));
+            }, samples, runs);
+            print_result(json, "Bezier3DTable", degree, samples, runs, bezier3DTable);
+
+            // Enough points per pair to produce about the same sample count
+            int between = std::max(1, samples / degree);
+            int produced = 1 + degree * (between - 1);
+            BenchResult interpolate = measure([&]() {
+                consume(curve.InterpolateBetweenPoints(b3, between));
+            }, std::max(1, produced), runs);
+            print_result(json, "InterpolateBetweenPoints", degree, produced, runs, interpolate);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Clustered light culling of point lights over the grid, no window or GL
+// context needed.
+//
+// Cameras fly low over the grid as in bench_occlusion, with the lights hung
+// over every other column around the point the camera looks at, as
+// main.cpp does with --lights. Each line of output is one (lights, radius)
+// case: the light to cluster assignments, the most lights a cluster gets,
+// and the median cost of binning them, as CSV by default or as one JSON
+// object per line with --json.
+//
+//   avgl_bench_lights [--json] [--runs N] [--grid-size N]
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "../src/LightClusters.hpp"
+#include "../src/ColumnHeights.hpp"
+
+using namespace std;
+using namespace glm;
+
+struct BenchResult
+{
+    int assignments;
+    int maxClusterLights;
+    double buildMs;
+};
+
+double milliseconds(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+double median(vector<double> & values)
+{
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Assignments are averaged over the cameras, timings are the mean of the
+// median over runs of each camera
+BenchResult measure(LightClusters & clusters, int gridSize, int lightCount, float radius, int runs)
+{
+    // Same projection as main.cpp, 45 is in radians for this glm
+    mat4 projection = perspective(45.f, 16.f / 9.f, 0.1f, 10000.f);
+    clusters.setProjection(projection);
+    float extent = gridSize * 0.5f;
+
+    BenchResult result = { 0, 0, 0.0 };
+    vector<vec4> viewSpheres(lightCount);
+    for (int c = 0; c < 8; ++c)
+    {
+        float heading = c * 0.785f + 0.3f;
+        vec3 eye(cos(c * 2.1f) * extent * 0.5f, 4.f, sin(c * 1.3f) * extent * 0.5f);
+        vec3 forward(cos(heading), -0.1f, sin(heading));
+        mat4 view = lookAt(eye, eye + forward, vec3(0.f, 1.f, 0.f));
+        vec3 target = eye + forward * 10.f;
+        float time = 3.f + c * 1.7f;
+
+        int side = int(std::ceil(std::sqrt(float(lightCount))));
+        int centerX = int(std::floor(target.x / 2.f + 0.5f)) + gridSize / 2;
+        int centerZ = int(std::floor(target.z / 2.f + 0.5f)) + gridSize / 2;
+        for (int i = 0; i < lightCount; ++i)
+        {
+            int x = centerX + (i % side - side / 2) * 2;
+            int z = centerZ + (i / side - side / 2) * 2;
+            float top = 0.f;
+            if (x >= 0 && x < gridSize && z >= 0 && z < gridSize)
+                top = ColumnHeights::height(z * gridSize + x, gridSize, time, eye);
+            vec3 position((x - gridSize / 2) * 2.f, top + 1.f, (z - gridSize / 2) * 2.f);
+            viewSpheres[i] = vec4(vec3(view * vec4(position, 1.f)), radius);
+        }
+
+        vector<double> build(runs);
+        for (int r = 0; r < runs; ++r)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            clusters.build(viewSpheres);
+            build[r] = milliseconds(start, chrono::steady_clock::now());
+        }
+
+        result.assignments += int(clusters.getLightIndices().size()) / 8;
+        result.maxClusterLights = std::max(result.maxClusterLights, clusters.getMaxClusterLightCount());
+        result.buildMs += median(build) / 8.0;
+    }
+    return result;
+}
+
+void print_result(bool json, int lightCount, float radius, const LightClusters & clusters, const BenchResult & result)
+{
+    if (json)
+        printf("{\"lights\":%d,\"radius\":%.1f,\"clusters\":%d,\"assignments\":%d,\"max_cluster_lights\":%d,\"build_ms\":%.4f}\n",
+               lightCount, radius, clusters.getClusterCount(), result.assignments, result.maxClusterLights, result.buildMs);
+    else
+        printf("%d,%.1f,%d,%d,%d,%.4f\n", lightCount, radius, clusters.getClusterCount(), result.assignments,
+               result.maxClusterLights, result.buildMs);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    int runs = 20;
+    int gridSize = 500;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--grid-size") && i + 1 < argc)
+            gridSize = std::max(1, atoi(argv[++i]));
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--json] [--runs N] [--grid-size N]" << endl;
+            return 1;
+        }
+    }
+
+    const int lightCounts[] = { 100, 250, 500, 1000, 2000, 4000 };
+    const float radii[] = { 3.f, 6.f, 12.f };
+
+    if (!json)
+        printf("lights,radius,clusters,assignments,max_cluster_lights,build_ms\n");
+
+    LightClusters clusters;
+    for (unsigned int r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r)
+        for (unsigned int l = 0; l < sizeof(lightCounts) / sizeof(lightCounts[0]); ++l)
+            print_result(json, lightCounts[l], radii[r], clusters, measure(clusters, gridSize, lightCounts[l], radii[r], runs));
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Software occlusion culling of the grid tiles, no window or GL context needed.
+//
+// Cameras fly low over the grid at a few altitudes and headings. Each line
+// of output is one (grid, altitude, threads) case: the tiles left in the
+// frustum, how many of them the occluders hid, and the median cost of
+// drawing the occluders and of testing the tiles, as CSV by default or as
+// one JSON object per line with --json.
+//
+//   avgl_bench_occlusion [--json] [--runs N] [--grid-size N] [--distance D]
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "../src/GridCuller.hpp"
+#include "../src/OcclusionRasterizer.hpp"
+
+using namespace std;
+using namespace glm;
+
+struct BenchResult
+{
+    int frustumTiles;
+    int occludedTiles;
+    double rasterMs;
+    double testMs;
+};
+
+double milliseconds(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+double median(vector<double> & values)
+{
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Sums over the cameras, timings are the median over runs of each camera
+BenchResult measure(GridCuller & culler, OcclusionRasterizer & occlusion, float altitude, float distance, int runs)
+{
+    // Same projection as main.cpp, 45 is in radians for this glm
+    mat4 projection = perspective(45.f, 16.f / 9.f, 0.1f, 10000.f);
+    float extent = culler.getGridSize() * 0.5f;
+
+    BenchResult result = { 0, 0, 0.0, 0.0 };
+    for (int c = 0; c < 8; ++c)
+    {
+        float heading = c * 0.785f + 0.3f;
+        vec3 eye(cos(c * 2.1f) * extent * 0.5f, altitude, sin(c * 1.3f) * extent * 0.5f);
+        vec3 forward(cos(heading), -0.1f, sin(heading));
+        mat4 viewProjection = projection * lookAt(eye, eye + forward, vec3(0.f, 1.f, 0.f));
+        float time = 3.f + c * 1.7f;
+
+        vector<double> raster(runs);
+        vector<double> test(runs);
+        for (int r = 0; r < runs; ++r)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            occlusion.begin(viewProjection, eye);
+            culler.addOccluders(occlusion, eye, time, distance);
+            occlusion.rasterize();
+            chrono::steady_clock::time_point rasterized = chrono::steady_clock::now();
+            culler.cull(viewProjection, eye, &occlusion);
+            chrono::steady_clock::time_point end = chrono::steady_clock::now();
+            raster[r] = milliseconds(start, rasterized);
+            test[r] = milliseconds(rasterized, end);
+        }
+
+        result.frustumTiles += culler.getVisibleTileCount() + culler.getOccludedTileCount();
+        result.occludedTiles += culler.getOccludedTileCount();
+        result.rasterMs += median(raster) / 8.0;
+        result.testMs += median(test) / 8.0;
+    }
+    return result;
+}
+
+void print_result(bool json, int gridSize, float altitude, int threads, const BenchResult & result)
+{
+    double ratio = result.frustumTiles ? double(result.occludedTiles) / result.frustumTiles : 0.0;
+    if (json)
+        printf("{\"grid\":%d,\"altitude\":%.1f,\"threads\":%d,\"tiles_in_frustum\":%d,\"tiles_occluded\":%d,\"culled_ratio\":%.3f,\"raster_ms\":%.4f,\"test_ms\":%.4f}\n",
+               gridSize, altitude, threads, result.frustumTiles, result.occludedTiles, ratio, result.rasterMs, result.testMs);
+    else
+        printf("%d,%.1f,%d,%d,%d,%.3f,%.4f,%.4f\n", gridSize, altitude, threads, result.frustumTiles, result.occludedTiles,
+               ratio, result.rasterMs, result.testMs);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    int runs = 20;
+    int gridSize = 500;
+    float distance = 48.f;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--grid-size") && i + 1 < argc)
+            gridSize = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--distance") && i + 1 < argc)
+            distance = std::max(0.f, float(atof(argv[++i])));
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--json] [--runs N] [--grid-size N] [--distance D]" << endl;
+            return 1;
+        }
+    }
+
+    const float altitudes[] = { 2.f, 3.f, 4.f, 6.f, 8.f, 12.f };
+    int hardwareThreads = std::max(1, int(thread::hardware_concurrency()));
+
+    if (!json)
+        printf("grid,altitude,threads,tiles_in_frustum,tiles_occluded,culled_ratio,raster_ms,test_ms\n");
+
+    GridCuller culler;
+    culler.build(gridSize);
+
+    for (int threads = 1; threads <= hardwareThreads; threads *= 2)
+    {
+        OcclusionRasterizer occlusion(256, 128, threads);
+        for (unsigned int a = 0; a < sizeof(altitudes) / sizeof(altitudes[0]); ++a)
+            print_result(json, gridSize, altitudes[a], occlusion.getThreadCount(), measure(culler, occlusion, altitudes[a], distance, runs));
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Checks of the curve evaluators, no window or GL context needed.
+//
+// Each failed check prints one line and the exit code is the failure
+// count, so CTest or a shell script can run it as is.
+//
+//   avgl_check_curves
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+#include <glm.hpp>
+
+#include "../src/BezierCurve.hpp"
+#include "../src/BezierEvaluator.hpp"
+#include "../src/BezierKernel.hpp"
+
+using namespace std;
+using namespace glm;
+
+static int g_Failures = 0;
+
+void check(bool condition, const char * what, int degree, double t)
+{
+    if (condition)
+        return;
+    printf("FAILED %s, degree %d, t %g\n", what, degree, t);
+    ++g_Failures;
+}
+
+bool finite3(const vec3 & p)
+{
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+// Reference sum over the de Casteljau basis, which only takes convex
+// combinations and cannot overflow
+vec3 reference(const vector<vec3> & b, double t)
+{
+    int n = int(b.size()) - 1;
+    vector<double> basis(n + 1);
+    BezierCurve::BernsteinRow(n, t, &basis[0]);
+    dvec3 sum(0.0);
+    for (int i = 0; i <= n; ++i)
+        sum += basis[i] * dvec3(b[i]);
+    return vec3(sum);
+}
+
+int main()
+{
+    const double ts[] = { 0.0, 0.1, 0.37, 0.5, 0.81, 1.0 };
+    const int tCount = sizeof(ts) / sizeof(ts[0]);
+
+    // Horner and the wide path against the reference, on both sides of
+    // BEZIER_HORNER_MAX_DEGREE
+    const int degrees[] = { 1, 3, 7, 32, 200, BEZIER_HORNER_MAX_DEGREE, BEZIER_HORNER_MAX_DEGREE + 1, 1000 };
+    for (unsigned int d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d)
+    {
+        int n = degrees[d];
+        vector<vec3> b(n + 1);
+        for (int i = 0; i <= n; ++i)
+            b[i] = vec3(cos(i * 0.7f), float(i % 5), sin(i * 0.7f)) * float(10 + i % 17);
+        BezierEvaluator<vec3> evaluator(b);
+        for (int k = 0; k < tCount; ++k)
+        {
+            vec3 p = evaluator.evaluate(ts[k]);
+            check(finite3(p), "finite", n, ts[k]);
+            check(length(p - reference(b, ts[k])) < 1e-3f, "matches the de Casteljau basis", n, ts[k]);
+        }
+    }
+
+    // Unrolled kernels, alone and through the BezierCurve wrappers
+    BezierCurve curve;
+    for (int n = 0; n <= BEZIER_KERNEL_MAX_DEGREE; ++n)
+    {
+        vector<vec3> b(n + 1);
+        for (int i = 0; i <= n; ++i)
+            b[i] = vec3(cos(i * 0.7f), float(i % 5), sin(i * 0.7f)) * float(10 + i);
+        for (int k = 0; k < tCount; ++k)
+            check(length(EvaluateBezier<3, float>(&b[0], n + 1, float(ts[k])) - reference(b, ts[k])) < 1e-3f, "kernel matches the de Casteljau basis", n, ts[k]);
+        vector<vec3> samples = curve.Bezier3D(b, 11);
+        for (int k = 0; k < 11; ++k)
+            check(length(samples[k] - reference(b, k / 10.0)) < 1e-3f, "Bezier3D matches the de Casteljau basis", n, k / 10.0);
+    }
+
+    // Large coordinates: the Horner sum grows like 2^n times them, so a
+    // high degree must not overflow on the way to a point of the same size
+    const int largeDegrees[] = { BEZIER_HORNER_MAX_DEGREE, 1000 };
+    const float magnitudes[] = { 1e9f, 1e30f };
+    for (unsigned int d = 0; d < sizeof(largeDegrees) / sizeof(largeDegrees[0]); ++d)
+    {
+        for (unsigned int m = 0; m < sizeof(magnitudes) / sizeof(magnitudes[0]); ++m)
+        {
+            int n = largeDegrees[d];
+            float magnitude = magnitudes[m];
+            vector<vec3> b(n + 1, vec3(magnitude, -magnitude, 0.5f * magnitude));
+            BezierEvaluator<vec3> evaluator(b);
+            for (int k = 0; k < tCount; ++k)
+            {
+                vec3 p = evaluator.evaluate(ts[k]);
+                check(finite3(p), "finite at large magnitude", n, ts[k]);
+                check(length(p - b[0]) <= 1e-4f * magnitude, "constant curve at large magnitude", n, ts[k]);
+            }
+        }
+    }
+
+    if (g_Failures)
+        cerr << g_Failures << " check(s) failed" << endl;
+    else
+        cout << "all curve checks passed" << endl;
+    return g_Failures;
+}
@@ -0,0 +1,257 @@
+// Checks of the point light clusters, no window or GL context needed.
+//
+// Lights inside the frustum, across the near and far planes, across the
+// screen edges and out of view are binned by the SSE loop of LightClusters
+// and by its scalar loop, built from check_lights_scalar.cpp. Both must
+// give the same clusters, and those must agree with a brute force test of
+// each sphere against every cluster: a cluster whose frustum cell the
+// sphere reaches must have the light, and a cluster that has the light
+// must have its view space box, which LightClusters tests, touch the
+// sphere. Each failed check prints one line and the exit code is the
+// failure count.
+//
+//   avgl_check_lights
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "../src/LightClusters.hpp"
+// Same class again, named ScalarLightClusters by check_lights_scalar.cpp
+#undef LIGHT_CLUSTERS_H
+#define LightClusters ScalarLightClusters
+#include "../src/LightClusters.hpp"
+#undef LightClusters
+
+using namespace std;
+using namespace glm;
+
+static int g_Failures = 0;
+
+void check(bool condition, const char * what, const LightClusters & clusters, int light)
+{
+    if (condition)
+        return;
+    printf("FAILED %s, %dx%dx%d clusters, light %d\n", what,
+           clusters.getTilesX(), clusters.getTilesY(), clusters.getSlices(), light);
+    ++g_Failures;
+}
+
+// Light indices of cluster c
+vector<unsigned int> clusterLights(const vector<unsigned int> & clusters, const vector<unsigned int> & indices, int c)
+{
+    vector<unsigned int>::const_iterator first = indices.begin() + clusters[c * 2];
+    return vector<unsigned int>(first, first + clusters[c * 2 + 1]);
+}
+
+// Distance from c to the interval [low, high]
+double outside(double c, double low, double high)
+{
+    return std::max(0.0, std::max(low - c, c - high));
+}
+
+// Distance from a sphere center to the frustum cell and to the view space
+// box of every cluster, in double. A cell spans ndc [x0, x1] * tanHalfX * d
+// across depths d of its slice. Its box, the one LightClusters tests, takes
+// the widest of those bounds over the slice.
+void clusterDistances(const mat4 & projection, int tilesX, int tilesY, int slices, const vec4 & sphere,
+                      vector<double> & cellDistances, vector<double> & boxDistances)
+{
+    double tanHalfX = 1.0 / projection[0][0];
+    double tanHalfY = 1.0 / projection[1][1];
+    double n = projection[3][2] / (projection[2][2] - 1.0);
+    double f = projection[3][2] / (projection[2][2] + 1.0);
+    double depth = -sphere.z;
+    cellDistances.resize(tilesX * tilesY * slices);
+    boxDistances.resize(tilesX * tilesY * slices);
+    for (int s = 0; s < slices; ++s)
+    {
+        double d0 = n * std::pow(f / n, double(s) / slices);
+        double d1 = n * std::pow(f / n, double(s + 1) / slices);
+        for (int y = 0; y < tilesY; ++y)
+        {
+            double y0 = (-1.0 + 2.0 * y / tilesY) * tanHalfY;
+            double y1 = (-1.0 + 2.0 * (y + 1) / tilesY) * tanHalfY;
+            for (int x = 0; x < tilesX; ++x)
+            {
+                double x0 = (-1.0 + 2.0 * x / tilesX) * tanHalfX;
+                double x1 = (-1.0 + 2.0 * (x + 1) / tilesX) * tanHalfX;
+                int c = (s * tilesY + y) * tilesX + x;
+
+                double dx = outside(sphere.x, std::min(x0 * d0, x0 * d1), std::max(x1 * d0, x1 * d1));
+                double dy = outside(sphere.y, std::min(y0 * d0, y0 * d1), std::max(y1 * d0, y1 * d1));
+                double dz = outside(depth, d0, d1);
+                boxDistances[c] = std::sqrt(dx * dx + dy * dy + dz * dz);
+                // The cell is inside its box, no closer to the sphere
+                cellDistances[c] = boxDistances[c];
+                if (boxDistances[c] > sphere.w)
+                    continue;
+
+                // The squared distance to the rectangle of the cell at
+                // depth d is convex in d, a ternary search finds its least
+                double low = d0;
+                double high = d1;
+                double least2 = 0.0;
+                for (int i = 0; i < 60; ++i)
+                {
+                    double d[2] = { low + (high - low) / 3.0, high - (high - low) / 3.0 };
+                    double distance2[2];
+                    for (int k = 0; k < 2; ++k)
+                    {
+                        dx = outside(sphere.x, x0 * d[k], x1 * d[k]);
+                        dy = outside(sphere.y, y0 * d[k], y1 * d[k]);
+                        dz = depth - d[k];
+                        distance2[k] = dx * dx + dy * dy + dz * dz;
+                    }
+                    if (distance2[0] < distance2[1])
+                        high = d[1];
+                    else
+                        low = d[0];
+                    least2 = std::min(distance2[0], distance2[1]);
+                }
+                cellDistances[c] = std::sqrt(least2);
+            }
+        }
+    }
+}
+
+// Lights that touch the frustum edges, plus random ones in and around it
+vector<vec4> testLights(const mat4 & projection)
+{
+    float tanHalfX = 1.f / projection[0][0];
+    float tanHalfY = 1.f / projection[1][1];
+    vector<vec4> lights;
+
+    // Across the near plane, 0.1 away, and behind the camera
+    lights.push_back(vec4(0.f, 0.f, -0.05f, 0.5f));
+    lights.push_back(vec4(0.3f, -0.2f, 0.f, 0.4f));
+    lights.push_back(vec4(-1.f, 0.5f, 0.6f, 1.f));
+    lights.push_back(vec4(0.f, 0.f, 2.f, 1.f));
+    lights.push_back(vec4(0.05f, 0.05f, -0.1f, 0.02f));
+    // Across the far plane, 10000 away, and past it
+    lights.push_back(vec4(100.f, -50.f, -9998.f, 10.f));
+    lights.push_back(vec4(0.f, 0.f, -10020.f, 10.f));
+    // Centers just outside each screen edge, reaching in or not
+    const float depths[] = { 0.5f, 3.f, 40.f, 700.f };
+    for (int i = 0; i < 4; ++i)
+    {
+        float d = depths[i];
+        for (int side = -1; side <= 1; side += 2)
+        {
+            float radius = d * 0.05f;
+            lights.push_back(vec4(side * (tanHalfX * d + radius * 0.5f), 0.f, -d, radius));
+            lights.push_back(vec4(side * (tanHalfX * d + radius * 2.f), 0.f, -d, radius));
+            lights.push_back(vec4(0.f, side * (tanHalfY * d + radius * 0.5f), -d, radius));
+            lights.push_back(vec4(side * (tanHalfX * d + radius * 0.3f), side * (tanHalfY * d + radius * 0.3f), -d, radius));
+        }
+    }
+    // Zero radius, and one light over everything
+    lights.push_back(vec4(0.f, 0.f, -5.f, 0.f));
+    lights.push_back(vec4(0.f, 0.f, -5.f, 20000.f));
+
+    // Random lights of all sizes over a box a bit wider than the frustum
+    unsigned int seed = 12345u;
+    for (int i = 0; i < 400; ++i)
+    {
+        float r[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            r[k] = float(seed >> 8) / float(1 << 24);
+        }
+        float d = std::pow(10.f, r[2] * 4.5f - 1.5f);
+        float radius = d * std::pow(10.f, r[3] * 2.f - 2.5f);
+        lights.push_back(vec4((r[0] * 2.4f - 1.2f) * tanHalfX * d, (r[1] * 2.4f - 1.2f) * tanHalfY * d, -d, radius));
+    }
+    return lights;
+}
+
+void checkClusters(int tilesX, int tilesY, int slices)
+{
+    // Same projection as main.cpp, 45 is in radians for this glm
+    mat4 projection = perspective(45.f, 16.f / 9.f, 0.1f, 10000.f);
+    LightClusters clusters(tilesX, tilesY, slices);
+    ScalarLightClusters scalarClusters(tilesX, tilesY, slices);
+    clusters.setProjection(projection);
+    scalarClusters.setProjection(projection);
+
+    vector<vec4> lights = testLights(projection);
+    clusters.build(lights);
+    scalarClusters.build(lights);
+    check(clusters.getClusters() == scalarClusters.getClusters(), "SSE and scalar cluster ranges match", clusters, -1);
+    check(clusters.getLightIndices() == scalarClusters.getLightIndices(), "SSE and scalar light indices match", clusters, -1);
+
+    const vector<unsigned int> & ranges = clusters.getClusters();
+    const vector<unsigned int> & indices = clusters.getLightIndices();
+    int clusterCount = clusters.getClusterCount();
+    check(int(ranges.size()) == clusterCount * 2, "one range per cluster", clusters, -1);
+
+    // Ranges follow each other and list their lights in order
+    vector< vector<bool> > binned(lights.size(), vector<bool>(clusterCount, false));
+    unsigned int offset = 0;
+    int maxCount = 0;
+    bool ordered = true;
+    for (int c = 0; c < clusterCount; ++c)
+    {
+        check(ranges[c * 2] == offset, "cluster ranges are contiguous", clusters, -1);
+        offset = ranges[c * 2] + ranges[c * 2 + 1];
+        maxCount = std::max(maxCount, int(ranges[c * 2 + 1]));
+        vector<unsigned int> own = clusterLights(ranges, indices, c);
+        for (unsigned int i = 0; i < own.size(); ++i)
+        {
+            ordered = ordered && (i == 0 || own[i - 1] < own[i]);
+            if (own[i] < lights.size())
+                binned[own[i]][c] = true;
+        }
+    }
+    check(offset == indices.size(), "ranges cover every light index", clusters, -1);
+    check(ordered, "lights of a cluster are in order", clusters, -1);
+    check(maxCount == clusters.getMaxClusterLightCount(), "most lights of a cluster", clusters, -1);
+
+    // Clusters within a hair of the sphere surface may go either way with
+    // float rounding
+    for (unsigned int l = 0; l < lights.size(); ++l)
+    {
+        vector<double> cellDistances;
+        vector<double> boxDistances;
+        clusterDistances(projection, tilesX, tilesY, slices, lights[l], cellDistances, boxDistances);
+        double radius = lights[l].w;
+        double tolerance = 1e-5 * (length(vec3(lights[l])) + radius) + 1e-6;
+        bool missing = false;
+        bool extra = false;
+        for (int c = 0; c < clusterCount; ++c)
+        {
+            missing = missing || (radius > 0.0 && cellDistances[c] < radius - tolerance && !binned[l][c]);
+            extra = extra || ((radius <= 0.0 || boxDistances[c] > radius + tolerance) && binned[l][c]);
+        }
+        check(!missing, "every cluster the light touches has it", clusters, l);
+        check(!extra, "no cluster box away from the light has it", clusters, l);
+    }
+
+    // Building again reuses the buffers and gives the same clusters
+    vector<unsigned int> firstIndices = indices;
+    clusters.build(vector<vec4>(1, vec4(0.f, 0.f, -5.f, 1.f)));
+    clusters.build(lights);
+    check(clusters.getLightIndices() == firstIndices, "a second build gives the same clusters", clusters, -1);
+
+    // No light leaves every cluster empty
+    clusters.build(vector<vec4>());
+    check(clusters.getLightIndices().empty() && clusters.getMaxClusterLightCount() == 0, "no lights, empty clusters", clusters, -1);
+}
+
+int main()
+{
+    // main.cpp's clusters, and rows that are not a multiple of 4 tiles
+    checkClusters(16, 9, 24);
+    checkClusters(17, 5, 24);
+    checkClusters(3, 2, 7);
+
+    if (g_Failures == 0)
+        cout << "all light cluster checks passed" << endl;
+    return g_Failures;
+}
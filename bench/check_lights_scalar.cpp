@@ -0,0 +1,7 @@
+// LightClusters.cpp built again with its scalar loop, as
+// ScalarLightClusters, so check_lights.cpp runs both paths on the same
+// lights in one process.
+
+#define CLUSTERS_NO_SSE
+#define LightClusters ScalarLightClusters
+#include "../src/LightClusters.cpp"
@@ -0,0 +1,270 @@
+// Checks of the mesh optimizer, no window or GL context needed.
+//
+// The cube and the sphere of main.cpp go through the passes of
+// Mesh::optimize(): vertex merging, vertex cache order per range, then
+// vertex fetch order. Every range must draw the same triangles, with the
+// same vertices and winding, and no triangle may move across a split. A
+// shuffled grid checks that the cache order lowers the miss ratio. Each
+// failed check prints one line and the exit code is the failure count.
+//
+//   avgl_check_mesh
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+
+#include "../src/MeshOptimizer.hpp"
+
+using namespace std;
+using namespace glm;
+
+static int g_Failures = 0;
+
+void check(bool condition, const char * what, const char * mesh)
+{
+    if (condition)
+        return;
+    printf("FAILED %s, %s\n", what, mesh);
+    ++g_Failures;
+}
+
+// Interleaved vertices of stride floats and a triangle list cut by splits
+struct TestMesh
+{
+    vector<float> Vertices;
+    int Stride;
+    vector<unsigned int> Indices;
+    vector<int> Splits;
+
+    int getVertexCount() const
+    {
+        return int(Vertices.size()) / Stride;
+    }
+};
+
+// Triangles of [first, end) by the values of their vertices, each rotated
+// to start at its smallest vertex so the winding is kept, then sorted
+vector< vector<float> > triangles(const TestMesh & mesh, int first, int end)
+{
+    vector< vector<float> > result;
+    for (int i = first; i + 2 < end; i += 3)
+    {
+        vector<float> corners[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            const float * v = &mesh.Vertices[mesh.Indices[i + k] * mesh.Stride];
+            corners[k].assign(v, v + mesh.Stride);
+        }
+        int start = int(min_element(corners, corners + 3) - corners);
+        vector<float> triangle;
+        for (int k = 0; k < 3; ++k)
+            triangle.insert(triangle.end(), corners[(start + k) % 3].begin(), corners[(start + k) % 3].end());
+        result.push_back(triangle);
+    }
+    sort(result.begin(), result.end());
+    return result;
+}
+
+// The passes of Mesh::optimize(), which needs GL for the rest of Mesh.
+// Returns the vertex count after merging.
+int optimize(TestMesh & mesh)
+{
+    int vertexCount = mesh.getVertexCount();
+    vector<unsigned int> merged;
+    int uniqueCount = MeshOptimizer::buildDeduplicationRemap(&mesh.Vertices[0], mesh.Stride, vertexCount, merged);
+    MeshOptimizer::remapIndices(mesh.Indices, merged);
+
+    int first = 0;
+    for (unsigned int s = 0; s <= mesh.Splits.size(); ++s)
+    {
+        int end = s < mesh.Splits.size() ? mesh.Splits[s] : int(mesh.Indices.size());
+        MeshOptimizer::optimizeVertexCache(mesh.Indices, first, end - first, uniqueCount);
+        first = end;
+    }
+
+    vector<unsigned int> fetch;
+    MeshOptimizer::buildFetchRemap(mesh.Indices, uniqueCount, fetch);
+    MeshOptimizer::remapIndices(mesh.Indices, fetch);
+
+    vector<unsigned int> combined(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        combined[v] = fetch[merged[v]];
+    MeshOptimizer::remapVertices(mesh.Vertices, mesh.Stride, combined, uniqueCount);
+    return uniqueCount;
+}
+
+// Returns the ACMR after the passes
+float checkMesh(const TestMesh & source, int expectedVertexCount, const char * name)
+{
+    TestMesh mesh = source;
+    int uniqueCount = optimize(mesh);
+    check(uniqueCount == expectedVertexCount, "vertex count after merging", name);
+    check(mesh.getVertexCount() == uniqueCount, "vertex streams hold the merged vertices", name);
+    check(mesh.Indices.size() == source.Indices.size(), "index count", name);
+
+    // Every range draws the same triangles; ranges are compared in place,
+    // so a triangle moved across a split shows in both ranges it touches
+    int first = 0;
+    for (unsigned int s = 0; s <= source.Splits.size(); ++s)
+    {
+        int end = s < source.Splits.size() ? source.Splits[s] : int(source.Indices.size());
+        check(triangles(mesh, first, end) == triangles(source, first, end), "range keeps its triangles", name);
+        first = end;
+    }
+
+    // Vertices are numbered in the order the indices first use them
+    unsigned int next = 0;
+    bool fetchOrder = true;
+    for (unsigned int i = 0; i < mesh.Indices.size(); ++i)
+    {
+        fetchOrder = fetchOrder && mesh.Indices[i] <= next;
+        if (mesh.Indices[i] == next)
+            ++next;
+    }
+    check(fetchOrder, "vertices in first use order", name);
+
+    float before = MeshOptimizer::computeAcmr(source.Indices, source.getVertexCount());
+    float after = MeshOptimizer::computeAcmr(mesh.Indices, mesh.getVertexCount());
+    printf("%s: %d -> %d vertices, ACMR %.3f -> %.3f\n", name, source.getVertexCount(), uniqueCount, before, after);
+    check(after <= before, "ACMR does not grow", name);
+    return after;
+}
+
+// The cube of main.cpp: the top face, indices 6 to 11, is drawn alone
+TestMesh cube()
+{
+    unsigned int cube_triangleList[] = {0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7, 8, 9, 10, 10, 9, 11, 12, 13, 14, 14, 13, 15, 16, 17, 18, 19, 17, 20, 21, 22, 23, 24, 25, 26, };
+    float cube_uvs[] = {0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 1.f, 0.125f, 0.5f};
+    float cube_vertices[] = {-0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, -0.5f, 0.5, 1.f, 0.5, 0.5, 1.f, 0.5, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, -0.5f, -0.5f, 1.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, 0.5, 0.f, 1.f, 0.f };
+    float cube_normals[] = {0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, 0, 1, 0, };
+
+    TestMesh mesh;
+    mesh.Stride = 8;
+    int vertexCount = sizeof(cube_vertices) / (3 * sizeof(float));
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        mesh.Vertices.insert(mesh.Vertices.end(), cube_vertices + v * 3, cube_vertices + v * 3 + 3);
+        mesh.Vertices.insert(mesh.Vertices.end(), cube_normals + v * 3, cube_normals + v * 3 + 3);
+        mesh.Vertices.insert(mesh.Vertices.end(), cube_uvs + v * 2, cube_uvs + v * 2 + 2);
+    }
+    mesh.Indices.assign(cube_triangleList, cube_triangleList + sizeof(cube_triangleList) / sizeof(cube_triangleList[0]));
+    mesh.Splits.push_back(6);
+    mesh.Splits.push_back(12);
+    return mesh;
+}
+
+// The sphere of main.cpp, 41 bands that each repeat the ring vertices of
+// the one before
+TestMesh sphere()
+{
+    TestMesh mesh;
+    mesh.Stride = 6;
+    int lats = 40;
+    int longs = 40;
+    unsigned int indicator = 0;
+    for (int i = 0; i <= lats; i++)
+    {
+        double lat0 = pi<double>() * (-0.5 + (double) (i - 1) / lats);
+        double lat1 = pi<double>() * (-0.5 + (double) i / lats);
+        for (int j = 0; j <= longs; j++)
+        {
+            double lng = 2 * pi<double>() * (double) (j - 1) / longs;
+            double x = cos(lng);
+            double y = sin(lng);
+            double lat[2] = { lat0, lat1 };
+            for (int k = 0; k < 2; ++k)
+            {
+                vec3 p(float(x * cos(lat[k])), float(y * cos(lat[k])), float(sin(lat[k])));
+                vec3 normal = normalize(vec3(x * cos(lat[k]), y * cos(lat[k]), sin(lat[k])));
+                mesh.Vertices.push_back(p.x);
+                mesh.Vertices.push_back(p.y);
+                mesh.Vertices.push_back(p.z);
+                mesh.Vertices.push_back(normal.x);
+                mesh.Vertices.push_back(normal.y);
+                mesh.Vertices.push_back(normal.z);
+                indicator++;
+            }
+        }
+        for (int j = 0; j < longs; j++)
+        {
+            unsigned int a = indicator - 2 * (longs + 1) + 2 * j;
+            unsigned int quad[] = { a, a + 1, a + 2, a + 2, a + 1, a + 3 };
+            mesh.Indices.insert(mesh.Indices.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+// n x n quads of a grid, positions only, triangles in a shuffled order
+TestMesh shuffledGrid(int n)
+{
+    TestMesh mesh;
+    mesh.Stride = 3;
+    for (int z = 0; z <= n; ++z)
+    {
+        for (int x = 0; x <= n; ++x)
+        {
+            mesh.Vertices.push_back(float(x));
+            mesh.Vertices.push_back(0.f);
+            mesh.Vertices.push_back(float(z));
+        }
+    }
+    vector<unsigned int> quads;
+    for (int z = 0; z < n; ++z)
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            unsigned int a = unsigned(z * (n + 1) + x);
+            unsigned int b = a + unsigned(n + 1);
+            unsigned int quad[] = { a, b, a + 1, a + 1, b, b + 1 };
+            quads.insert(quads.end(), quad, quad + 6);
+        }
+    }
+    int triangleCount = int(quads.size()) / 3;
+    vector<int> order(triangleCount);
+    for (int t = 0; t < triangleCount; ++t)
+        order[t] = t;
+    unsigned int seed = 12345u;
+    for (int t = triangleCount - 1; t > 0; --t)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        swap(order[t], order[(seed >> 8) % unsigned(t + 1)]);
+    }
+    for (int t = 0; t < triangleCount; ++t)
+        mesh.Indices.insert(mesh.Indices.end(), quads.begin() + order[t] * 3, quads.begin() + order[t] * 3 + 3);
+    return mesh;
+}
+
+int main()
+{
+    // Two side faces of the cube repeat three of their vertices, left are
+    // four per face and the top centre. The sphere bands share their rings.
+    TestMesh cubeMesh = cube();
+    check(cubeMesh.getVertexCount() == 28, "cube vertex count before merging", "cube");
+    checkMesh(cubeMesh, 25, "cube");
+    TestMesh sphereMesh = sphere();
+    check(sphereMesh.getVertexCount() == 3362, "sphere vertex count before merging", "sphere");
+    checkMesh(sphereMesh, 1644, "sphere");
+
+    // Random order misses on almost every vertex, the cache order should
+    // come close to the 0.5 of a regular grid
+    TestMesh grid = shuffledGrid(100);
+    float shuffledAcmr = MeshOptimizer::computeAcmr(grid.Indices, grid.getVertexCount());
+    check(shuffledAcmr > 2.5f, "shuffled grid misses the cache", "grid");
+    check(checkMesh(grid, grid.getVertexCount(), "grid") < 0.8f, "grid ACMR below 0.8", "grid");
+
+    // Large ranges, where the cache order moves every triangle
+    int triangleCount = int(grid.Indices.size()) / 3;
+    grid.Splits.push_back(triangleCount / 3 * 3);
+    grid.Splits.push_back(triangleCount * 2 / 3 * 3);
+    checkMesh(grid, grid.getVertexCount(), "grid in three ranges");
+
+    if (g_Failures == 0)
+        cout << "all mesh checks passed" << endl;
+    return g_Failures;
+}
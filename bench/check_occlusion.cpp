@@ -0,0 +1,91 @@
+// Checks of the software occlusion rasterizer, no window or GL context
+// needed.
+//
+// A camera at the origin looks down -Z at a wall, and boxes around the wall
+// must come out hidden or visible as expected, with any thread count. Each
+// failed check prints one line and the exit code is the failure count.
+//
+//   avgl_check_occlusion
+
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "../src/OcclusionRasterizer.hpp"
+
+using namespace std;
+using namespace glm;
+
+static int g_Failures = 0;
+
+void check(bool condition, const char * what, int threads)
+{
+    if (condition)
+        return;
+    printf("FAILED %s, %d thread(s)\n", what, threads);
+    ++g_Failures;
+}
+
+int main()
+{
+    // Same projection as main.cpp, 45 is in radians for this glm
+    mat4 projection = perspective(45.f, 16.f / 9.f, 0.1f, 10000.f);
+    vec3 eye(0.f);
+    mat4 viewProjection = projection * lookAt(eye, vec3(0.f, 0.f, -1.f), vec3(0.f, 1.f, 0.f));
+
+    // Wall 10 to 11 units away, 4 units on each side of the view axis. The
+    // two triangles of its face leave their shared diagonal, from the bottom
+    // left to the top right, unwritten: the hidden boxes sit above it.
+    vec3 wallMin(-4.f, -4.f, -11.f);
+    vec3 wallMax(4.f, 4.f, -10.f);
+    vec3 hiddenMin(-6.f, 2.f, -30.f);
+    vec3 hiddenMax(-4.f, 4.f, -28.f);
+
+    vector<float> firstDepth;
+    const int threadCounts[] = { 1, 2, 4, 7 };
+    for (unsigned int i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i)
+    {
+        OcclusionRasterizer occlusion(256, 128, threadCounts[i]);
+        int threads = occlusion.getThreadCount();
+
+        occlusion.begin(viewProjection, eye);
+        occlusion.rasterize();
+        check(!occlusion.isOccluded(hiddenMin, hiddenMax), "nothing hides a box in an empty buffer", threads);
+
+        occlusion.begin(viewProjection, eye);
+        occlusion.addOccluder(wallMin, wallMax);
+        occlusion.rasterize();
+        check(occlusion.getTriangleCount() == 2, "a box seen straight on has one face toward the eye", threads);
+        check(occlusion.isOccluded(hiddenMin, hiddenMax), "box behind the wall is hidden", threads);
+        check(occlusion.isOccluded(vec3(-3.f, 1.f, -12.f), vec3(-1.f, 3.f, -11.5f)), "box right behind the wall is hidden", threads);
+        check(!occlusion.isOccluded(vec3(-1.f, -1.f, -6.f), vec3(1.f, 1.f, -5.f)), "box in front of the wall is visible", threads);
+        check(!occlusion.isOccluded(vec3(-1.f, -1.f, -10.5f), vec3(1.f, 1.f, -9.f)), "box through the wall is visible", threads);
+        check(!occlusion.isOccluded(vec3(3.f, 1.f, -60.f), vec3(40.f, 3.f, -50.f)), "box reaching past the wall edge is visible", threads);
+        check(!occlusion.isOccluded(vec3(-5.f, 2.f, -30.f), vec3(-4.f, 3.f, 1.f)), "box behind the camera is visible", threads);
+
+        // Every thread count draws the same buffer
+        if (firstDepth.empty())
+            firstDepth = occlusion.getDepth();
+        else
+            check(occlusion.getDepth() == firstDepth, "depth matches the single thread buffer", threads);
+
+        // begin() clears the last frame, the thread pool is reused
+        for (int frame = 0; frame < 50; ++frame)
+        {
+            occlusion.begin(viewProjection, eye);
+            if (frame % 2)
+                occlusion.addOccluder(wallMin, wallMax);
+            occlusion.rasterize();
+            check(occlusion.isOccluded(hiddenMin, hiddenMax) == (frame % 2 == 1), "frames do not leak into each other", threads);
+        }
+    }
+
+    if (g_Failures)
+        cerr << g_Failures << " check(s) failed" << endl;
+    else
+        cout << "all occlusion checks passed" << endl;
+    return g_Failures;
+}
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <time.h>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include <GL/glew.h>
 
@@ -13,9 +15,17 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
-#include <gtx/vector_angle.hpp>
+#include <gtc/quaternion.hpp>
 
 #include "src/BezierCurve.hpp"
+#include "src/Spline.hpp"
+#include "src/CameraPath.hpp"
+#include "src/WaypointGenerator.hpp"
+#include "src/GridCuller.hpp"
+#include "src/OcclusionRasterizer.hpp"
+#include "src/LightClusters.hpp"
+#include "src/ColumnHeights.hpp"
+#include "src/Mesh.hpp"
 
 #ifndef DEBUG
 #define DEBUG 0
@@ -32,7 +42,10 @@ extern const unsigned int DroidSans_ttf_len;
 int check_link_error(GLuint program);
 int check_compile_error(GLuint shader, const char ** sourceBuffer);
 GLuint compile_shader(GLenum shaderType, const char * sourceBuffer, int bufferSize);
-GLuint compile_shader_from_file(GLenum shaderType, const char * fileName);
+// defines, "#define NAME\n" lines, go right after the #version line, then
+// the source of each file of includePaths, a 0 terminated list of files
+// shared by several shaders
+GLuint compile_shader_from_file(GLenum shaderType, const char * fileName, const char * defines = 0, const char * const * includePaths = 0);
 
 // OpenGL utils
 bool checkError(const char* title);
@@ -47,12 +60,27 @@ struct Camera
     vec3 up;
 };
 
+// One light of the std140 lights block of lighting.glsl, 32 bytes
+struct DirectionalLight
+{
+    vec3 direction;
+    int padding;
+    vec3 color;
+    float intensity;
+};
+
 void camera_compute(Camera & c);
 void camera_defaults(Camera & c);
 void camera_zoom(Camera & c, float factor);
 void camera_turn(Camera & c, float phi, float theta);
 void camera_pan(Camera & c, float x, float y);
-float angleBetween(vec3 a, vec3 b, vec3 ref);
+
+// How the grid columns are drawn
+enum GridMode
+{
+    GRID_CUBES = 0,      // one instanced cube per column
+    GRID_HEIGHTFIELD = 1 // one patch mesh per tile through the column tops
+};
 
 struct GUIStates
 {
@@ -85,7 +113,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
         glfwSetWindowShouldClose(window, GL_TRUE);
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
     /******************
      * Global Variables
@@ -95,11 +123,46 @@ int main(void)
     float currentTime;
 
     int grid_size = 500;
+    // Bounds of a grid column: x and z spacing, tallest cube
+    float cubeSpacing = 2.f;
+    float cubeMaxHeight = 11.f;
+    bool gpuCulling = true;
+    // Hi-Z test of the GPU culling, against the depth of the last frame,
+    // or the software depth of the nearest columns when culling on the CPU
+    bool occlusionCulling = true;
+    float occluderDistance = 48.f;
+    int gridMode = GRID_CUBES;
+    // Columns drop to their top face, then to a point, once they are
+    // narrower than these many pixels on screen
+    float lodTopSize = 8.f;
+    float lodPointSize = 1.f;
+    float lodHysteresis = 0.1f;
+    // Half float positions and uvs, packed normals and small indices for
+    // the cube and the sphere, instead of floats
+    bool compactVertices = true;
+    // Octahedral normal and specular power in one GL_RGB10_A2 target,
+    // instead of a GL_RGBA32F normal
+    bool compactGbuffer = true;
+    // Cube grid drawn as column and face ids, then shaded into the gbuffer
+    // in one fullscreen pass
+    bool visibilityBuffer = false;
+    // Depth prepass, then the grid and sphere lit in their own fragment
+    // shaders straight into the fx chain, instead of the gbuffer
+    bool forwardShading = false;
 
     int directionalLightCount = 1;
     float directionalLightIntensity = 1.f;
     vec3 directionalLightColor = vec3(1.f, 0.f, 0.f);
     vec4 directionalLightDir = vec4(-1.0, -1.0, 0.0, 0.0);
+    // Point lights hung over the columns around the sphere, one every
+    // other column, colored from colorNear to colorFar
+    int pointLightCount = 0;
+    float pointLightIntensity = 2.f;
+    float pointLightRadius = 6.f;
+    // Array size of the lights block in dirLight.frag
+    const int MAX_DIRECTIONAL_LIGHTS = 16;
+    // Point lights are binned in clusters, the bound is only for the slider
+    const int MAX_POINT_LIGHTS = 4096;
 
     vec3 sphereColor(1.f);
 
@@ -113,6 +176,38 @@ int main(void)
     int sampleCount = 5;
     float gamma = 1.2f;
 
+    // Camera tour seed, the same seed always flies the same path
+    unsigned int cameraSeed = 1;
+
+
+    /**************
+     * Command line
+     *************/
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            cameraSeed = unsigned(strtoul(argv[++i], NULL, 10));
+        else if (!strcmp(argv[i], "--cpu-culling"))
+            gpuCulling = false;
+        else if (!strcmp(argv[i], "--no-occlusion"))
+            occlusionCulling = false;
+        else if (!strcmp(argv[i], "--full-vertices"))
+            compactVertices = false;
+        else if (!strcmp(argv[i], "--full-gbuffer"))
+            compactGbuffer = false;
+        else if (!strcmp(argv[i], "--visibility-buffer"))
+            visibilityBuffer = true;
+        else if (!strcmp(argv[i], "--forward"))
+            forwardShading = true;
+        else if (!strcmp(argv[i], "--heightfield"))
+            gridMode = GRID_HEIGHTFIELD;
+        else if (!strcmp(argv[i], "--grid-size") && i + 1 < argc)
+            grid_size = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--lights") && i + 1 < argc)
+            pointLightCount = std::min(std::max(0, atoi(argv[++i])), MAX_POINT_LIGHTS);
+    }
+
 
     /****************************
      * Window Initialization GLFW
@@ -190,41 +285,31 @@ int main(void)
     float farPlane = 50.0;
 
     // Camera Path
-    unsigned int timer = unsigned(time(NULL));
-    BezierCurve bSmoother;
+    int cameraWaypointCount = 32;
     vector<vec3> cameraPath;
 
     cameraPath.push_back(vec3(-100, 100, -100));
     cameraPath.push_back(vec3(-150, 0, -150));
     cameraPath.push_back(vec3(0, 0, 0));
 
-    for(int i = 0; i < bSmoother.getFactorialMax() - cameraPath.size() - 1; ++i)
-    {
-        vec3 newPos;
-        srand(i * timer);
-        newPos.x = (rand() % grid_size) - (grid_size / 2);
-        srand(i+1 * timer);
-        newPos.y = (rand() % 16)+1;
-        srand(i+2 * timer);
-        newPos.z = (rand() % grid_size) - (grid_size / 2);
-
-        unsigned int j = 3;
-        while (i && int(distance(newPos, cameraPath[i - 1])) < 200)
-        {
-            srand((i + j + 0) * timer);
-            newPos.x = (rand() % grid_size) - (grid_size / 2);
-            srand((i + j + 2) * timer);
-            newPos.z = (rand() % grid_size) - (grid_size / 2);
-
-            ++j;
-        }
-
-        cameraPath.push_back(newPos);
-    }
-    cameraPath.push_back(cameraPath.front());
-
-    int smoothValue = 50;
-    vector<vec3> cameraSmoothPath = bSmoother.Bezier3D(cameraPath, bSmoother.getFactorialMax() * smoothValue);
+    WaypointGenerator waypointGenerator(cameraSeed, grid_size);
+    waypointGenerator.setMinDistance(200.f);
+    waypointGenerator.setHeightRange(1.f, 16.f);
+    waypointGenerator.generate(cameraPath, cameraWaypointCount - int(cameraPath.size()));
+
+    // Closed piecewise curve, so the tour length is not tied to a single Bezier degree
+    Spline cameraSpline(cameraPath, Spline::B_SPLINE, true);
+
+    // Resample at uniform arc length so the camera moves at constant speed.
+    // The spline is flattened adaptively first, the polyline stays within
+    // cameraTourTolerance of the curve.
+    float cameraTourTolerance = 0.25f;
+    int cameraTourResolution = cameraWaypointCount * 16;
+    float cameraSecondsPerWaypoint = 1.25f;
+    CameraPath cameraTour;
+    cameraTour.setLeveling(50.f);
+    cameraTour.build(cameraSpline.SampleAdaptive(cameraTourTolerance), cameraTourResolution, true);
+    cameraTour.setDuration(cameraWaypointCount * cameraSecondsPerWaypoint);
 
     /**************
      * Framebuffers
@@ -248,7 +333,10 @@ int main(void)
 
     // Create normal texture
     glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+    if (compactGbuffer)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 0);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -282,6 +370,49 @@ int main(void)
         exit( EXIT_FAILURE );
     }
 
+    // Visibility buffer: one 32-bit id per pixel, sharing the gbuffer depth
+    GLuint visFbo;
+    GLuint visTexture;
+    glGenTextures(1, &visTexture);
+    glBindTexture(GL_TEXTURE_2D, visTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &visFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, visFbo);
+    glDrawBuffers(1, gbufferDrawBuffers);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, visTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferTextures[2], 0);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "Error on building framebuffer" << endl;
+        exit( EXIT_FAILURE );
+    }
+
+    // Shaders writing or reading the gbuffer pick its layout from this
+    const char * gbufferDefines = compactGbuffer ? "#define COMPACT_GBUFFER\n" : 0;
+    // Shared shader code, see gbuffer.glsl and lighting.glsl
+    const char * gbufferIncludes[] = { "shaders/gbuffer.glsl", 0 };
+    const char * lightingIncludes[] = { "shaders/lighting.glsl", 0 };
+    const char * deferredLightingIncludes[] = { "shaders/gbuffer.glsl", "shaders/lighting.glsl", 0 };
+
+#if DEBUG
+    // Color, normal and depth (24 bits stored in 4 bytes)
+    int gbufferBytesPerPixel = 4 + (compactGbuffer ? 4 : 16) + 4;
+
+    // GPU time of the gbuffer and lighting passes. Each frame uses its own
+    // pair of queries and reads the pair of two frames ago, which is done.
+    GLuint timerQueries[2][2];
+    glGenQueries(4, &timerQueries[0][0]);
+    int timerFrame = 0;
+    double gbufferPassTime = 0.0;
+    double lightingPassTime = 0.0;
+#endif
+
 
     /*****************
      * FX Framebuffers
@@ -317,6 +448,21 @@ int main(void)
         cerr << "Error on building FX framebuffer" << endl;
         exit( EXIT_FAILURE );
     }
+
+    // Forward shading renders into the first fx texture, over the gbuffer
+    // depth the fx chain reads
+    GLuint forwardFbo;
+    glGenFramebuffers(1, &forwardFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, forwardFbo);
+    glDrawBuffers(1, fxDrawBuffers);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferTextures[2], 0);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "Error on building forward framebuffer" << endl;
+        exit( EXIT_FAILURE );
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     checkError("Framebuffers");
@@ -327,7 +473,7 @@ int main(void)
      ********/
 
     GLuint vertShaderCubeGrid = compile_shader_from_file(GL_VERTEX_SHADER, "shaders/cube_grid.vert");
-    GLuint fragShaderCubeGrid = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/cube_grid.frag");
+    GLuint fragShaderCubeGrid = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/cube_grid.frag", gbufferDefines, gbufferIncludes);
     GLuint programCubeGrid = glCreateProgram();
     glAttachShader(programCubeGrid, vertShaderCubeGrid);
     glAttachShader(programCubeGrid, fragShaderCubeGrid);
@@ -336,8 +482,53 @@ int main(void)
     if (check_link_error(programCubeGrid) < 0)
         exit(1);
 
+    // Heightfield, same fragment stage as the cubes
+    GLuint vertShaderHeightfield = compile_shader_from_file(GL_VERTEX_SHADER, "shaders/heightfield.vert");
+    GLuint programHeightfield = glCreateProgram();
+    glAttachShader(programHeightfield, vertShaderHeightfield);
+    glAttachShader(programHeightfield, fragShaderCubeGrid);
+    glLinkProgram(programHeightfield);
+
+    if (check_link_error(programHeightfield) < 0)
+        exit(1);
+
+    // Height and color of every column, one vertex per column captured by
+    // transform feedback, so the noise runs once per column per frame
+    GLuint vertShaderCubeColumns = compile_shader_from_file(GL_VERTEX_SHADER, "shaders/cube_columns.vert");
+    GLuint programCubeColumns = glCreateProgram();
+    glAttachShader(programCubeColumns, vertShaderCubeColumns);
+    const char * cubeColumnsVaryings[] = { "Instance" };
+    glTransformFeedbackVaryings(programCubeColumns, 1, cubeColumnsVaryings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(programCubeColumns);
+
+    if (check_link_error(programCubeColumns) < 0)
+        exit(1);
+
+    // GPU culling needs compute shaders, indirect draws and buffer clears,
+    // GL 4.3, and falls back to the CPU tiles without them
+    bool hasGpuCulling = GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_multi_draw_indirect &&
+                                              GLEW_ARB_clear_buffer_object);
+    GLuint programCullGrid = 0;
+    GLuint programHiZ = 0;
+    if (hasGpuCulling)
+    {
+        GLuint compShaderCullGrid = compile_shader_from_file(GL_COMPUTE_SHADER, "shaders/cull_grid.comp");
+        programCullGrid = glCreateProgram();
+        glAttachShader(programCullGrid, compShaderCullGrid);
+        glLinkProgram(programCullGrid);
+
+        GLuint compShaderHiZ = compile_shader_from_file(GL_COMPUTE_SHADER, "shaders/hiz_build.comp");
+        programHiZ = glCreateProgram();
+        glAttachShader(programHiZ, compShaderHiZ);
+        glLinkProgram(programHiZ);
+
+        if (check_link_error(programCullGrid) < 0 || check_link_error(programHiZ) < 0)
+            hasGpuCulling = false;
+    }
+    gpuCulling = gpuCulling && hasGpuCulling;
+
     GLuint vertShaderSphere = compile_shader_from_file(GL_VERTEX_SHADER, "shaders/sphere.vert");
-    GLuint fragShaderSphere = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/sphere.frag");
+    GLuint fragShaderSphere = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/sphere.frag", gbufferDefines, gbufferIncludes);
     GLuint programSphere = glCreateProgram();
     glAttachShader(programSphere, vertShaderSphere);
     glAttachShader(programSphere, fragShaderSphere);
@@ -356,8 +547,61 @@ int main(void)
     if (check_link_error(programBlit) < 0)
         exit(1);
 
+    // Visibility buffer: the cube grid vertex stage writing ids, then a
+    // fullscreen pass shading them into the gbuffer
+    GLuint fragShaderVisGrid = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/vis_grid.frag");
+    GLuint programVisGrid = glCreateProgram();
+    glAttachShader(programVisGrid, vertShaderCubeGrid);
+    glAttachShader(programVisGrid, fragShaderVisGrid);
+    glLinkProgram(programVisGrid);
+
+    GLuint fragShaderVisResolve = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/vis_resolve.frag", gbufferDefines, gbufferIncludes);
+    GLuint programVisResolve = glCreateProgram();
+    glAttachShader(programVisResolve, vertShaderBlit);
+    glAttachShader(programVisResolve, fragShaderVisResolve);
+    glLinkProgram(programVisResolve);
+
+    if (check_link_error(programVisGrid) < 0 || check_link_error(programVisResolve) < 0)
+        exit(1);
+
+    // Forward shading: vertex stage only programs for the depth prepass,
+    // then the fragment stages built with FORWARD, which light the surface
+    GLuint programCubeGridDepth = glCreateProgram();
+    glAttachShader(programCubeGridDepth, vertShaderCubeGrid);
+    glLinkProgram(programCubeGridDepth);
+
+    GLuint programHeightfieldDepth = glCreateProgram();
+    glAttachShader(programHeightfieldDepth, vertShaderHeightfield);
+    glLinkProgram(programHeightfieldDepth);
+
+    GLuint programSphereDepth = glCreateProgram();
+    glAttachShader(programSphereDepth, vertShaderSphere);
+    glLinkProgram(programSphereDepth);
+
+    GLuint fragShaderCubeGridForward = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/cube_grid.frag", "#define FORWARD\n", lightingIncludes);
+    GLuint programCubeGridForward = glCreateProgram();
+    glAttachShader(programCubeGridForward, vertShaderCubeGrid);
+    glAttachShader(programCubeGridForward, fragShaderCubeGridForward);
+    glLinkProgram(programCubeGridForward);
+
+    GLuint programHeightfieldForward = glCreateProgram();
+    glAttachShader(programHeightfieldForward, vertShaderHeightfield);
+    glAttachShader(programHeightfieldForward, fragShaderCubeGridForward);
+    glLinkProgram(programHeightfieldForward);
+
+    GLuint fragShaderSphereForward = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/sphere.frag", "#define FORWARD\n", lightingIncludes);
+    GLuint programSphereForward = glCreateProgram();
+    glAttachShader(programSphereForward, vertShaderSphere);
+    glAttachShader(programSphereForward, fragShaderSphereForward);
+    glLinkProgram(programSphereForward);
+
+    if (check_link_error(programCubeGridDepth) < 0 || check_link_error(programHeightfieldDepth) < 0 ||
+        check_link_error(programSphereDepth) < 0 || check_link_error(programCubeGridForward) < 0 ||
+        check_link_error(programHeightfieldForward) < 0 || check_link_error(programSphereForward) < 0)
+        exit(1);
+
     // Try to load and compile directionallight shaders
-    GLuint fragShaderDirLight = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/dirLight.frag");
+    GLuint fragShaderDirLight = compile_shader_from_file(GL_FRAGMENT_SHADER, "shaders/dirLight.frag", gbufferDefines, deferredLightingIncludes);
     GLuint programDirLight = glCreateProgram();
     glAttachShader(programDirLight, vertShaderBlit);
     glAttachShader(programDirLight, fragShaderDirLight);
@@ -440,15 +684,124 @@ int main(void)
     GLint mvpLocation = glGetUniformLocation(programCubeGrid, "MVP");
     GLint mvLocation = glGetUniformLocation(programCubeGrid, "MV");
     GLint grid_sizeLocation = glGetUniformLocation(programCubeGrid, "grid_size");
-    GLint timeLocation = glGetUniformLocation(programCubeGrid, "time");
-    GLint colorNearLocation = glGetUniformLocation(programCubeGrid, "colorNear");
-    GLint colorFarLocation = glGetUniformLocation(programCubeGrid, "colorFar");
+    GLint columnsLocation = glGetUniformLocation(programCubeGrid, "Columns");
+    glProgramUniform1i(programCubeGrid, columnsLocation, 3);
     GLint brightnessLocation = glGetUniformLocation(programCubeGrid, "brightness");
     GLint attenuationLocation = glGetUniformLocation(programCubeGrid, "attenuation");
     GLint cameraPosLocation = glGetUniformLocation(programCubeGrid, "camPos");
     GLint lightDirLocation = glGetUniformLocation(programCubeGrid, "lightDir");
     glProgramUniform3fv(programCubeGrid, lightDirLocation, 1, value_ptr(directionalLightDir));
 
+    GLint mvpHeightfieldLocation = glGetUniformLocation(programHeightfield, "MVP");
+    GLint mvHeightfieldLocation = glGetUniformLocation(programHeightfield, "MV");
+    GLint grid_sizeHeightfieldLocation = glGetUniformLocation(programHeightfield, "grid_size");
+    GLint brightnessHeightfieldLocation = glGetUniformLocation(programHeightfield, "brightness");
+    GLint attenuationHeightfieldLocation = glGetUniformLocation(programHeightfield, "attenuation");
+    GLint cameraPosHeightfieldLocation = glGetUniformLocation(programHeightfield, "camPos");
+    glProgramUniform1i(programHeightfield, glGetUniformLocation(programHeightfield, "Columns"), 3);
+    glProgramUniform3fv(programHeightfield, glGetUniformLocation(programHeightfield, "lightDir"), 1, value_ptr(directionalLightDir));
+
+    GLint columnsGridSizeLocation = glGetUniformLocation(programCubeColumns, "grid_size");
+    GLint timeLocation = glGetUniformLocation(programCubeColumns, "time");
+    GLint columnsCameraPosLocation = glGetUniformLocation(programCubeColumns, "camPos");
+    GLint colorNearLocation = glGetUniformLocation(programCubeColumns, "colorNear");
+    GLint colorFarLocation = glGetUniformLocation(programCubeColumns, "colorFar");
+
+    GLint cullPlanesLocation = -1;
+    GLint cullGridSizeLocation = -1;
+    GLint cullCameraPosLocation = -1;
+    GLint cullLodDistancesLocation = -1;
+    GLint cullPhaseLocation = -1;
+    GLint cullOcclusionLocation = -1;
+    GLint cullHiZViewProjectionLocation = -1;
+    GLint hizLevelLocation = -1;
+    if (hasGpuCulling)
+    {
+        cullPlanesLocation = glGetUniformLocation(programCullGrid, "planes");
+        cullGridSizeLocation = glGetUniformLocation(programCullGrid, "grid_size");
+        cullCameraPosLocation = glGetUniformLocation(programCullGrid, "camPos");
+        cullLodDistancesLocation = glGetUniformLocation(programCullGrid, "lodDistances");
+        glProgramUniform1f(programCullGrid, glGetUniformLocation(programCullGrid, "lodHysteresis"), lodHysteresis);
+        glProgramUniform1i(programCullGrid, glGetUniformLocation(programCullGrid, "Columns"), 3);
+        glProgramUniform1f(programCullGrid, glGetUniformLocation(programCullGrid, "spacing"), cubeSpacing);
+
+        cullPhaseLocation = glGetUniformLocation(programCullGrid, "phase");
+        cullOcclusionLocation = glGetUniformLocation(programCullGrid, "occlusion");
+        cullHiZViewProjectionLocation = glGetUniformLocation(programCullGrid, "hizViewProjection");
+        glProgramUniform1i(programCullGrid, glGetUniformLocation(programCullGrid, "HiZ"), 4);
+        hizLevelLocation = glGetUniformLocation(programHiZ, "level");
+        glProgramUniform1i(programHiZ, glGetUniformLocation(programHiZ, "Depth"), 4);
+    }
+
+    GLint mvpVisGridLocation = glGetUniformLocation(programVisGrid, "MVP");
+    GLint mvVisGridLocation = glGetUniformLocation(programVisGrid, "MV");
+    GLint grid_sizeVisGridLocation = glGetUniformLocation(programVisGrid, "grid_size");
+    GLint pointsVisGridLocation = glGetUniformLocation(programVisGrid, "points");
+    glProgramUniform1i(programVisGrid, glGetUniformLocation(programVisGrid, "Columns"), 3);
+
+    GLint inverseMvpVisResolveLocation = glGetUniformLocation(programVisResolve, "InverseMVP");
+    GLint mvVisResolveLocation = glGetUniformLocation(programVisResolve, "MV");
+    GLint grid_sizeVisResolveLocation = glGetUniformLocation(programVisResolve, "grid_size");
+    GLint brightnessVisResolveLocation = glGetUniformLocation(programVisResolve, "brightness");
+    GLint attenuationVisResolveLocation = glGetUniformLocation(programVisResolve, "attenuation");
+    GLint cameraPosVisResolveLocation = glGetUniformLocation(programVisResolve, "camPos");
+    glProgramUniform1i(programVisResolve, glGetUniformLocation(programVisResolve, "Visibility"), 0);
+    glProgramUniform1i(programVisResolve, glGetUniformLocation(programVisResolve, "Columns"), 3);
+
+    // Both forward shading stages of the cube grid and the heightfield,
+    // then of the sphere, share their vertex stage uniforms
+    const int FORWARD_GRID_PROGRAM_COUNT = 4;
+    GLuint forwardGridPrograms[FORWARD_GRID_PROGRAM_COUNT] = { programCubeGridDepth, programCubeGridForward, programHeightfieldDepth, programHeightfieldForward };
+    GLint forwardGridMvLocations[FORWARD_GRID_PROGRAM_COUNT];
+    GLint forwardGridMvpLocations[FORWARD_GRID_PROGRAM_COUNT];
+    GLint forwardGridGridSizeLocations[FORWARD_GRID_PROGRAM_COUNT];
+    for (int i = 0; i < FORWARD_GRID_PROGRAM_COUNT; ++i)
+    {
+        forwardGridMvLocations[i] = glGetUniformLocation(forwardGridPrograms[i], "MV");
+        forwardGridMvpLocations[i] = glGetUniformLocation(forwardGridPrograms[i], "MVP");
+        forwardGridGridSizeLocations[i] = glGetUniformLocation(forwardGridPrograms[i], "grid_size");
+        glProgramUniform1i(forwardGridPrograms[i], glGetUniformLocation(forwardGridPrograms[i], "Columns"), 3);
+    }
+    const int FORWARD_SPHERE_PROGRAM_COUNT = 2;
+    GLuint forwardSpherePrograms[FORWARD_SPHERE_PROGRAM_COUNT] = { programSphereDepth, programSphereForward };
+    GLint forwardSphereMvLocations[FORWARD_SPHERE_PROGRAM_COUNT];
+    GLint forwardSphereMvpLocations[FORWARD_SPHERE_PROGRAM_COUNT];
+    GLint forwardSpherePositionLocations[FORWARD_SPHERE_PROGRAM_COUNT];
+    for (int i = 0; i < FORWARD_SPHERE_PROGRAM_COUNT; ++i)
+    {
+        forwardSphereMvLocations[i] = glGetUniformLocation(forwardSpherePrograms[i], "MV");
+        forwardSphereMvpLocations[i] = glGetUniformLocation(forwardSpherePrograms[i], "MVP");
+        forwardSpherePositionLocations[i] = glGetUniformLocation(forwardSpherePrograms[i], "position_scripted");
+    }
+
+    // Programs reading the lights block, all from uniform buffer binding 0,
+    // and the point light clusters, from texture units 5 to 7
+    const int LIT_PROGRAM_COUNT = 4;
+    GLuint litPrograms[LIT_PROGRAM_COUNT] = { programDirLight, programCubeGridForward, programHeightfieldForward, programSphereForward };
+    GLint directionalLightCountLocations[LIT_PROGRAM_COUNT];
+    GLint clusterTileScaleLocations[LIT_PROGRAM_COUNT];
+    GLint clusterSliceLocations[LIT_PROGRAM_COUNT];
+    LightClusters lightClusters;
+    for (int i = 0; i < LIT_PROGRAM_COUNT; ++i)
+    {
+        directionalLightCountLocations[i] = glGetUniformLocation(litPrograms[i], "directionalLightCount");
+        clusterTileScaleLocations[i] = glGetUniformLocation(litPrograms[i], "clusterTileScale");
+        clusterSliceLocations[i] = glGetUniformLocation(litPrograms[i], "clusterSlice");
+        glUniformBlockBinding(litPrograms[i], glGetUniformBlockIndex(litPrograms[i], "lights"), 0);
+        glProgramUniform1i(litPrograms[i], glGetUniformLocation(litPrograms[i], "PointLights"), 5);
+        glProgramUniform1i(litPrograms[i], glGetUniformLocation(litPrograms[i], "LightClusters"), 6);
+        glProgramUniform1i(litPrograms[i], glGetUniformLocation(litPrograms[i], "LightIndices"), 7);
+        glProgramUniform3i(litPrograms[i], glGetUniformLocation(litPrograms[i], "clusterCount"),
+                           lightClusters.getTilesX(), lightClusters.getTilesY(), lightClusters.getSlices());
+    }
+    GLint brightnessForwardLocation = glGetUniformLocation(programCubeGridForward, "brightness");
+    GLint attenuationForwardLocation = glGetUniformLocation(programCubeGridForward, "attenuation");
+    GLint cameraPosForwardLocation = glGetUniformLocation(programCubeGridForward, "camPos");
+    GLint brightnessHeightfieldForwardLocation = glGetUniformLocation(programHeightfieldForward, "brightness");
+    GLint attenuationHeightfieldForwardLocation = glGetUniformLocation(programHeightfieldForward, "attenuation");
+    GLint cameraPosHeightfieldForwardLocation = glGetUniformLocation(programHeightfieldForward, "camPos");
+    GLint colorSphereForwardLocation = glGetUniformLocation(programSphereForward, "Color");
+
     GLint blitTextureLocation = glGetUniformLocation(programBlit, "Texture");
     glProgramUniform1i(programBlit, blitTextureLocation, 0);
 
@@ -456,7 +809,7 @@ int main(void)
     GLint directionallightNormalLocation = glGetUniformLocation(programDirLight, "NormalBuffer");
     GLint directionallightDepthLocation = glGetUniformLocation(programDirLight, "DepthBuffer");
     GLint mvLightLocation = glGetUniformLocation(programDirLight, "MV");
-    GLint directionallightLightLocation = glGetUniformBlockIndex(programDirLight, "light");
+    GLint directionallightLightsLocation = glGetUniformBlockIndex(programDirLight, "lights");
     GLint directionalInverseProjectionLocation = glGetUniformLocation(programDirLight, "InverseProjection");
     glProgramUniform1i(programDirLight, directionallightColorLocation, 0);
     glProgramUniform1i(programDirLight, directionallightNormalLocation, 1);
@@ -475,17 +828,39 @@ int main(void)
      * Uniform Buffers
      ****************/
 
-    // Update and bind uniform buffer object
+    // Directional lights of the frame, uploaded once per frame
     GLuint ubo[1];
     glGenBuffers(1, ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
     GLint uboSize = 0;
-    glGetActiveUniformBlockiv(programDirLight, (GLuint) directionallightLightLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &uboSize);
-
-    uboSize = 512;
+    glGetActiveUniformBlockiv(programDirLight, (GLuint) directionallightLightsLocation, GL_UNIFORM_BLOCK_DATA_SIZE, &uboSize);
     glBufferData(GL_UNIFORM_BUFFER, uboSize, 0, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+    // Point lights and their clusters, refilled every frame and read as
+    // buffer textures: lightBuffers[0] the view space lights, two vec4 each,
+    // lightBuffers[1] offset and count per cluster, lightBuffers[2] the
+    // light indices of all clusters back to back
+    const GLenum lightFormats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    GLuint lightBuffers[3];
+    GLuint lightTextures[3];
+    glGenBuffers(3, lightBuffers);
+    glGenTextures(3, lightTextures);
+    for (int i = 0; i < 3; ++i)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4), 0, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, lightFormats[i], lightBuffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    vector<vec4> pointLights;
+    vector<vec4> viewSpheres;
+#if DEBUG
+    double clusterTime = 0.0;
+#endif
+
 
     /***************
      * Blit geometry
@@ -522,39 +897,167 @@ int main(void)
 
     // Load geometry
     int cube_triangleCount = 12;
-    int cube_triangleList[] = {0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7, 8, 9, 10, 10, 9, 11, 12, 13, 14, 14, 13, 15, 16, 17, 18, 19, 17, 20, 21, 22, 23, 24, 25, 26, };
-    float cube_uvs[] = {0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f,  1.f, 0.f,  1.f, 1.f,  0.f, 1.f,  1.f, 1.f,  0.f, 0.f, 0.f, 0.f, 1.f, 1.f,  1.f, 0.f,  };
-    float cube_vertices[] = {-0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, -0.5f, 0.5, 1.f, 0.5, 0.5, 1.f, 0.5, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, -0.5f, -0.5f, 1.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, 0.5 };
-    float cube_normals[] = {0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, };
+    unsigned int cube_triangleList[] = {0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7, 8, 9, 10, 10, 9, 11, 12, 13, 14, 14, 13, 15, 16, 17, 18, 19, 17, 20, 21, 22, 23, 24, 25, 26, };
+    // Indices 6 to 11 are the top face, drawn alone by LOD_TOP
+    const int cube_topFirstIndex = 6;
+    // Vertex 27 is the centre of the top face, drawn alone by LOD_POINT; its
+    // u sits where the edge glow is about the mean of a whole face
+    int cube_pointVertex = 27;
+    // u runs up every side face, so a face cut short keeps its pattern
+    float cube_uvs[] = {0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 0.f, 1.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 1.f, 0.125f, 0.5f};
+    float cube_vertices[] = {-0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, 0.5, 0.5, 1.f, 0.5, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 1.f, -0.5f, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, -0.5f, 0.5, 0.f, -0.5f, -0.5f, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, 0.5, 0.5, 0.f, -0.5f, 0.5, 1.f, 0.5, 0.5, 1.f, 0.5, 0.5, 1.f, -0.5f, -0.5f, 0.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, -0.5f, -0.5f, 1.f, -0.5f, -0.5f, 0.f, 0.5, -0.5f, 1.f, 0.5, 0.f, 1.f, 0.f };
+    float cube_normals[] = {0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, 0, 1, 0, };
+
+    // Interleaved vertices, every value of the cube is exact in half float
+    Mesh cubeMesh;
+    cubeMesh.setData(cube_vertices, cube_normals, cube_uvs, sizeof(cube_vertices) / (3 * sizeof(float)),
+                     cube_triangleList, sizeof(cube_triangleList) / sizeof(cube_triangleList[0]));
+    // The top face keeps its own index range, and the point vertex is
+    // looked up again once the vertices move
+    float cubeAcmr = cubeMesh.getAcmr();
+    int cubeVertexCount = cubeMesh.getVertexCount();
+    vector<int> cube_faceSplits;
+    cube_faceSplits.push_back(cube_topFirstIndex);
+    cube_faceSplits.push_back(cube_topFirstIndex + 6);
+    vector<GLuint> cube_vertexRemap;
+    cubeMesh.optimize(cube_faceSplits, &cube_vertexRemap);
+    cube_pointVertex = cube_vertexRemap[cube_pointVertex];
+    printf("Cube: %d -> %d vertices, ACMR %.3f -> %.3f\n", cubeVertexCount, cubeMesh.getVertexCount(), cubeAcmr, cubeMesh.getAcmr());
+    cubeMesh.upload(compactVertices ? Mesh::VERTEX_COMPACT : Mesh::VERTEX_FLOAT);
 
     // Vertex Array Object
     GLuint vao;
     glGenVertexArrays(1, &vao);
 
-    // Vertex Buffer Objects
-    GLuint vbo[4];
-    glGenBuffers(4, vbo);
-
     // Cube
     glBindVertexArray(vao);
-    // Bind indices and upload data
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_triangleList), cube_triangleList, GL_STATIC_DRAW);
-    // Bind vertices and upload data
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+    cubeMesh.bindAttributes();
+
+    // Column of each instance, tile by tile, so a run of visible tiles is
+    // one draw starting at its base instance
+    GridCuller gridCuller;
+    gridCuller.build(grid_size, 32, cubeMaxHeight, cubeSpacing);
+    OcclusionRasterizer occlusionRasterizer(256, 128);
+#if DEBUG
+    double occlusionTime = 0.0;
+#endif
+    GLuint cube_columnVbo;
+    glGenBuffers(1, &cube_columnVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, cube_columnVbo);
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glBufferData(GL_ARRAY_BUFFER, gridCuller.getColumns().size() * sizeof(GLuint), &gridCuller.getColumns()[0], GL_STATIC_DRAW);
+
+    // Column pass output, a vec4 per column read back as a buffer texture.
+    // The pass has no vertex input, gl_VertexID is the column.
+    GLuint columnsVao;
+    glGenVertexArrays(1, &columnsVao);
+    GLuint columnsBuffer;
+    glGenBuffers(1, &columnsBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, columnsBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, grid_size * grid_size * sizeof(vec4), 0, GL_DYNAMIC_COPY);
+    GLuint columnsTexture;
+    glGenTextures(1, &columnsTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, columnsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, columnsBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Without base instance the column pointer is moved to each run instead
+    bool hasBaseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+
+    // GPU culling: the compute pass fills cullBuffers[0] with the visible
+    // columns, one list per level of detail, and the instance counts of the
+    // draw commands in cullBuffers[1]; this vao reads its columns from the
+    // former. cullBuffers[2] keeps the level of each column between frames.
+    GLuint cullVao;
+    glGenVertexArrays(1, &cullVao);
+    GLuint cullBuffers[3];
+    glGenBuffers(3, cullBuffers);
+
+    glBindVertexArray(cullVao);
+    cubeMesh.bindAttributes();
+    glBindBuffer(GL_ARRAY_BUFFER, cullBuffers[0]);
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glBufferData(GL_ARRAY_BUFFER, GridCuller::LOD_COUNT * grid_size * grid_size * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullBuffers[1]);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, 2 * 14 * sizeof(GLuint), 0, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullBuffers[2]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, grid_size * grid_size * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+    // Level 0 and not rejected, phase 1 would read garbage REJECTED bits
+    if (hasGpuCulling)
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Hi-Z pyramid, the farthest depth of the gbuffer over each texel of
+    // each level, with the matrix that depth was rendered with
+    GLuint hizTexture = 0;
+    int hizLevels = 1;
+    while ((std::max(width, height) >> hizLevels) > 0)
+        ++hizLevels;
+    mat4 hizViewProjection;
+    bool hizValid = false;
+    if (hasGpuCulling)
+    {
+        glGenTextures(1, &hizTexture);
+        glBindTexture(GL_TEXTURE_2D, hizTexture);
+        glTexStorage2D(GL_TEXTURE_2D, hizLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+
+    /*************
+     * Heightfield
+     ************/
+
+    // One patch per visible tile, a quad per column on (tile + 1)^2 column
+    // corners shared with the neighbouring patches; instanced by tile
+    const int patchSize = 32;
+    vector<GLubyte> patch_vertices;
+    vector<GLushort> patch_indices;
+    for (int z = 0; z <= patchSize; ++z)
+    {
+        for (int x = 0; x <= patchSize; ++x)
+        {
+            patch_vertices.push_back(GLubyte(x));
+            patch_vertices.push_back(GLubyte(z));
+        }
+    }
+    for (int z = 0; z < patchSize; ++z)
+    {
+        for (int x = 0; x < patchSize; ++x)
+        {
+            GLushort corner = GLushort(z * (patchSize + 1) + x);
+            GLushort quad[] = { corner, GLushort(corner + patchSize + 1), GLushort(corner + 1),
+                                GLushort(corner + 1), GLushort(corner + patchSize + 1), GLushort(corner + patchSize + 2) };
+            patch_indices.insert(patch_indices.end(), quad, quad + 6);
+        }
+    }
+    int patch_triangleCount = int(patch_indices.size()) / 3;
+
+    GLuint patch_vao;
+    glGenVertexArrays(1, &patch_vao);
+    GLuint patch_vbo[3];
+    glGenBuffers(3, patch_vbo);
+
+    glBindVertexArray(patch_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch_vbo[0]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, patch_indices.size() * sizeof(GLushort), &patch_indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, patch_vbo[1]);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
-    // Bind normals and upload data
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_normals), cube_normals, GL_STATIC_DRAW);
-    // Bind uv coords and upload data
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*2, (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_uvs), cube_uvs, GL_STATIC_DRAW);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_BYTE, sizeof(GLubyte)*2, (void*)0);
+    glBufferData(GL_ARRAY_BUFFER, patch_vertices.size() * sizeof(GLubyte), &patch_vertices[0], GL_STATIC_DRAW);
+    // Corner column of each visible tile, refilled every frame
+    glBindBuffer(GL_ARRAY_BUFFER, patch_vbo[2]);
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(3, 1);
 
 
     /********
@@ -585,7 +1088,6 @@ int main(void)
             sphere_vertices.push_back((float &&) (x * zr0));
             sphere_vertices.push_back((float &&) (y * zr0));
             sphere_vertices.push_back((const float &) z0);
-            sphere_indices.push_back((const unsigned int &) indicator);
 
             vec3 normal = normalize(vec3(x * zr0, y * zr0, z0));
             sphere_normals.push_back(normal.x);
@@ -597,7 +1099,6 @@ int main(void)
             sphere_vertices.push_back((float &&) (x * zr1));
             sphere_vertices.push_back((float &&) (y * zr1));
             sphere_vertices.push_back((const float &) z1);
-            sphere_indices.push_back((const unsigned int &) indicator);
 
             normal = normalize(vec3(x * zr1, y * zr1, z1));
             sphere_normals.push_back(normal.x);
@@ -606,32 +1107,34 @@ int main(void)
 
             indicator++;
         }
-        sphere_indices.push_back(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+        // Two triangles per quad of the band, between pairs j and j + 1
+        for(j = 0; j < longs; j++) {
+            GLuint a = indicator - 2 * (longs + 1) + 2 * j;
+            sphere_indices.push_back(a);
+            sphere_indices.push_back(a + 1);
+            sphere_indices.push_back(a + 2);
+            sphere_indices.push_back(a + 2);
+            sphere_indices.push_back(a + 1);
+            sphere_indices.push_back(a + 3);
+        }
     }
 
+    // Each band repeats the ring vertices of the last one, merged here
+    Mesh sphereMesh;
+    sphereMesh.setData(&sphere_vertices[0], &sphere_normals[0], 0, sphere_vertices.size() / 3,
+                       &sphere_indices[0], sphere_indices.size());
+    float sphereAcmr = sphereMesh.getAcmr();
+    int sphereVertexCount = sphereMesh.getVertexCount();
+    sphereMesh.optimize();
+    printf("Sphere: %d -> %d vertices, ACMR %.3f -> %.3f\n", sphereVertexCount, sphereMesh.getVertexCount(), sphereAcmr, sphereMesh.getAcmr());
+    sphereMesh.upload(compactVertices ? Mesh::VERTEX_COMPACT : Mesh::VERTEX_FLOAT);
+
     // Vertex Array Object
     GLuint sphere_vao;
     glGenVertexArrays(1, &sphere_vao);
 
-    // Vertex Buffer Objects
-    GLuint sphere_vbo[4];
-    glGenBuffers(4, sphere_vbo);
-
     glBindVertexArray(sphere_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sphere_vertices.size() * sizeof(GLfloat), &sphere_vertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray (0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo[1]);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT)*3, (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, sphere_normals.size()* sizeof(GLfloat), &sphere_normals[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_vbo[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_indices.size() * sizeof(GLuint), &sphere_indices[0], GL_STATIC_DRAW);
-
-    int numsToDraw = sphere_indices.size();
+    sphereMesh.bindAttributes();
 
 
     // Unbind
@@ -712,23 +1215,13 @@ int main(void)
 #if DEBUG
         mat4 worldToView = lookAt(camera.eye, camera.o, camera.up);
 #else
-        int indexEye = int(currentTime * 40) % (cameraSmoothPath.size());
-        int indexO = int((currentTime + 1.0 ) * 40) % (cameraSmoothPath.size());
-        int indexPrev = int((currentTime - 0.1 ) * 40) % (cameraSmoothPath.size());
+        // Orientation comes from the frames precomputed along the tour
+        camera.eye = cameraTour.positionAtTime(currentTime);
+        camera.o = cameraTour.positionAtTime(currentTime + 1.0f);
+        quat cameraOrientation = cameraTour.orientationAtTime(currentTime);
+        camera.up = cameraOrientation * vec3(0.f, 1.f, 0.f);
 
-        vec3 cameraBezierEye = cameraSmoothPath[indexEye];
-        camera.eye = cameraBezierEye;
-        vec3 cameraBezierO = cameraSmoothPath[(indexO + indexEye) / 2];
-        camera.o = cameraSmoothPath[indexO];
-        vec3 cameraPrevious = cameraSmoothPath[indexPrev];
-
-
-        float cameraAngle = (float) (
-                -angleBetween(cameraBezierO - cameraBezierEye, cameraBezierEye - cameraPrevious, vec3(1.f, 0.f, 0.f)) / M_PI);
-
-        camera.up = vec3(0, abs(cos(cameraAngle)), sin(cameraAngle));
-
-        mat4 worldToView = lookAt(cameraBezierEye, cameraBezierO, camera.up);
+        mat4 worldToView = mat4_cast(conjugate(cameraOrientation)) * translate(mat4(1.f), -camera.eye);
 #endif
         mat4 objectToWorld;
         mat4 mv = worldToView * objectToWorld;
@@ -736,10 +1229,26 @@ int main(void)
         mat4 inverseProjection = inverse(projection);
 
 
-        // Bind gbuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
+#if DEBUG
+        GLuint * frameQueries = timerQueries[timerFrame % 2];
+        if (timerFrame >= 2)
+        {
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(frameQueries[0], GL_QUERY_RESULT, &elapsed);
+            gbufferPassTime = elapsed * 1e-6;
+            glGetQueryObjectui64v(frameQueries[1], GL_QUERY_RESULT, &elapsed);
+            lightingPassTime = elapsed * 1e-6;
+        }
+        ++timerFrame;
+        glBeginQuery(GL_TIME_ELAPSED, frameQueries[0]);
+#endif
+
+        // Bind gbuffer, or the forward target whose depth the prepass fills
+        glBindFramebuffer(GL_FRAMEBUFFER, forwardShading ? forwardFbo : gbufferFbo);
         // Clear the gbuffer
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (forwardShading)
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
 
         // Select shader
@@ -749,13 +1258,23 @@ int main(void)
         glProgramUniformMatrix4fv(programCubeGrid, mvLocation, 1, 0, value_ptr(mv));
         glProgramUniformMatrix4fv(programCubeGrid, mvpLocation, 1, 0, value_ptr(mvp));
         glProgramUniform1i(programCubeGrid, grid_sizeLocation, grid_size);
-        glProgramUniform1f(programCubeGrid, timeLocation, currentTime);
-        glProgramUniform3fv(programCubeGrid, colorNearLocation, 1, value_ptr(colorNear));
-        glProgramUniform3fv(programCubeGrid, colorFarLocation, 1, value_ptr(colorFar));
         glProgramUniform1f(programCubeGrid, brightnessLocation, brightness);
         glProgramUniform1f(programCubeGrid, attenuationLocation, attenuation);
         glProgramUniform3fv(programCubeGrid, cameraPosLocation, 1, value_ptr(camera.eye));
 
+        glProgramUniformMatrix4fv(programHeightfield, mvHeightfieldLocation, 1, 0, value_ptr(mv));
+        glProgramUniformMatrix4fv(programHeightfield, mvpHeightfieldLocation, 1, 0, value_ptr(mvp));
+        glProgramUniform1i(programHeightfield, grid_sizeHeightfieldLocation, grid_size);
+        glProgramUniform1f(programHeightfield, brightnessHeightfieldLocation, brightness);
+        glProgramUniform1f(programHeightfield, attenuationHeightfieldLocation, attenuation);
+        glProgramUniform3fv(programHeightfield, cameraPosHeightfieldLocation, 1, value_ptr(camera.eye));
+
+        glProgramUniform1i(programCubeColumns, columnsGridSizeLocation, grid_size);
+        glProgramUniform1f(programCubeColumns, timeLocation, currentTime);
+        glProgramUniform3fv(programCubeColumns, columnsCameraPosLocation, 1, value_ptr(camera.eye));
+        glProgramUniform3fv(programCubeColumns, colorNearLocation, 1, value_ptr(colorNear));
+        glProgramUniform3fv(programCubeColumns, colorFarLocation, 1, value_ptr(colorFar));
+
         glProgramUniformMatrix4fv(programDirLight, directionalInverseProjectionLocation, 1, 0, value_ptr(inverseProjection));
         glProgramUniformMatrix4fv(programDirLight, mvLightLocation, 1, 0, value_ptr(mv));
 
@@ -764,76 +1283,429 @@ int main(void)
         glProgramUniform3fv(programSphere, colorSphereLocation, 1, value_ptr(sphereColor));
         glProgramUniform3fv(programSphere, position_scriptedLocation, 1, value_ptr(camera.o));
 
+        for (int i = 0; i < FORWARD_GRID_PROGRAM_COUNT; ++i)
+        {
+            glProgramUniformMatrix4fv(forwardGridPrograms[i], forwardGridMvLocations[i], 1, 0, value_ptr(mv));
+            glProgramUniformMatrix4fv(forwardGridPrograms[i], forwardGridMvpLocations[i], 1, 0, value_ptr(mvp));
+            glProgramUniform1i(forwardGridPrograms[i], forwardGridGridSizeLocations[i], grid_size);
+        }
+        for (int i = 0; i < FORWARD_SPHERE_PROGRAM_COUNT; ++i)
+        {
+            glProgramUniformMatrix4fv(forwardSpherePrograms[i], forwardSphereMvLocations[i], 1, 0, value_ptr(mv));
+            glProgramUniformMatrix4fv(forwardSpherePrograms[i], forwardSphereMvpLocations[i], 1, 0, value_ptr(mvp));
+            glProgramUniform3fv(forwardSpherePrograms[i], forwardSpherePositionLocations[i], 1, value_ptr(camera.o));
+        }
+        int activeDirectionalLightCount = std::min(directionalLightCount, MAX_DIRECTIONAL_LIGHTS);
+        int activePointLightCount = std::min(pointLightCount, MAX_POINT_LIGHTS);
+        lightClusters.setProjection(projection);
+        for (int i = 0; i < LIT_PROGRAM_COUNT; ++i)
+        {
+            glProgramUniform1i(litPrograms[i], directionalLightCountLocations[i], activeDirectionalLightCount);
+            glProgramUniform2f(litPrograms[i], clusterTileScaleLocations[i],
+                               float(lightClusters.getTilesX()) / width, float(lightClusters.getTilesY()) / height);
+            glProgramUniform2f(litPrograms[i], clusterSliceLocations[i], lightClusters.getSliceScale(), lightClusters.getSliceBias());
+        }
+        glProgramUniform1f(programCubeGridForward, brightnessForwardLocation, brightness);
+        glProgramUniform1f(programCubeGridForward, attenuationForwardLocation, attenuation);
+        glProgramUniform3fv(programCubeGridForward, cameraPosForwardLocation, 1, value_ptr(camera.eye));
+        glProgramUniform1f(programHeightfieldForward, brightnessHeightfieldForwardLocation, brightness);
+        glProgramUniform1f(programHeightfieldForward, attenuationHeightfieldForwardLocation, attenuation);
+        glProgramUniform3fv(programHeightfieldForward, cameraPosHeightfieldForwardLocation, 1, value_ptr(camera.eye));
+        glProgramUniform3fv(programSphereForward, colorSphereForwardLocation, 1, value_ptr(sphereColor));
+
         // Render vaos
 
-        // Cubes
-        glBindVertexArray(vao);
-        glDrawElementsInstanced(GL_TRIANGLES, cube_triangleCount * 3, GL_UNSIGNED_INT, (void*)0, grid_size * grid_size);
+        // Cubes, only the ones in the frustum. A column spacing wide at
+        // distance d covers spacing * projection[1][1] * height / (2 d)
+        // pixels, which gives the distance of each level of detail.
+        lodPointSize = std::min(lodPointSize, lodTopSize);
+        float lodTopDistance = cubeSpacing * projection[1][1] * height / (2.f * lodTopSize);
+        float lodPointDistance = cubeSpacing * projection[1][1] * height / (2.f * lodPointSize);
+        gridCuller.setLodDistances(lodTopDistance, lodPointDistance, lodHysteresis);
+        if (gridCuller.getGridSize() != grid_size)
+        {
+            gridCuller.build(grid_size, 32, cubeMaxHeight, cubeSpacing);
+            glBindBuffer(GL_ARRAY_BUFFER, cube_columnVbo);
+            glBufferData(GL_ARRAY_BUFFER, gridCuller.getColumns().size() * sizeof(GLuint), &gridCuller.getColumns()[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, cullBuffers[0]);
+            glBufferData(GL_ARRAY_BUFFER, GridCuller::LOD_COUNT * grid_size * grid_size * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, cullBuffers[2]);
+            glBufferData(GL_ARRAY_BUFFER, grid_size * grid_size * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+            if (hasGpuCulling)
+                glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+            glBindBuffer(GL_ARRAY_BUFFER, columnsBuffer);
+            glBufferData(GL_ARRAY_BUFFER, grid_size * grid_size * sizeof(vec4), 0, GL_DYNAMIC_COPY);
+        }
+        if (compactVertices != (cubeMesh.getFormat() == Mesh::VERTEX_COMPACT))
+        {
+            Mesh::VertexFormat format = compactVertices ? Mesh::VERTEX_COMPACT : Mesh::VERTEX_FLOAT;
+            cubeMesh.upload(format);
+            sphereMesh.upload(format);
+            glBindVertexArray(vao);
+            cubeMesh.bindAttributes();
+            glBindVertexArray(cullVao);
+            cubeMesh.bindAttributes();
+            glBindVertexArray(sphere_vao);
+            sphereMesh.bindAttributes();
+            glBindVertexArray(0);
+        }
 
-        // Sphere
+        // Column pass, nothing rasterized
+        glUseProgram(programCubeColumns);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, columnsBuffer);
+        glBeginTransformFeedback(GL_POINTS);
+        glBindVertexArray(columnsVao);
+        glDrawArrays(GL_POINTS, 0, grid_size * grid_size);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_BUFFER, columnsTexture);
+        glActiveTexture(GL_TEXTURE0);
 
-        glUseProgram(programSphere);
+        // With the visibility buffer the cubes only write their column and
+        // face, over the same depth, and get shaded once per pixel below
+        bool visibilityGrid = visibilityBuffer && gridMode == GRID_CUBES && !forwardShading;
+        GLuint programGrid = visibilityGrid ? programVisGrid : programCubeGrid;
+        if (forwardShading)
+            programGrid = programCubeGridDepth;
 
-        glBindVertexArray(sphere_vao);
-        glEnable(GL_PRIMITIVE_RESTART);
-        glPrimitiveRestartIndex(GL_PRIMITIVE_RESTART_FIXED_INDEX);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_vbo[1]);
-        glDrawElements(GL_QUAD_STRIP, numsToDraw, GL_UNSIGNED_INT, NULL);
-        glDisable(GL_PRIMITIVE_RESTART);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, fxFbo);
-        // Attach first fx texture to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
-        glClear(GL_COLOR_BUFFER_BIT);
+        // Draws the runs of the last CPU cull, each with the part of the
+        // cube mesh of its level of detail
+        auto drawGridRuns = [&]()
+        {
+            for (unsigned int r = 0; r < gridCuller.getRuns().size(); ++r)
+            {
+                const GridCuller::Run & run = gridCuller.getRuns()[r];
+                int indexCount = run.lod == GridCuller::LOD_TOP ? 6 : cube_triangleCount * 3;
+                void * indexOffset = (void*)(size_t)((run.lod == GridCuller::LOD_TOP ? cube_topFirstIndex : 0) * cubeMesh.getIndexSize());
+                if (visibilityGrid)
+                    glProgramUniform1i(programVisGrid, pointsVisGridLocation, run.lod == GridCuller::LOD_POINT);
+                if (hasBaseInstance)
+                {
+                    if (run.lod == GridCuller::LOD_POINT)
+                        glDrawArraysInstancedBaseInstance(GL_POINTS, cube_pointVertex, 1, run.count, run.first);
+                    else
+                        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, cubeMesh.getIndexType(), indexOffset, run.count, run.first);
+                }
+                else
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, cube_columnVbo);
+                    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)(run.first * sizeof(GLuint)));
+                    if (run.lod == GridCuller::LOD_POINT)
+                        glDrawArraysInstanced(GL_POINTS, cube_pointVertex, 1, run.count);
+                    else
+                        glDrawElementsInstanced(GL_TRIANGLES, indexCount, cubeMesh.getIndexType(), indexOffset, run.count);
+                }
+            }
+            if (!hasBaseInstance)
+                glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        };
+        glUseProgram(programGrid);
+        if (visibilityGrid)
+        {
+            glProgramUniformMatrix4fv(programVisGrid, mvVisGridLocation, 1, 0, value_ptr(mv));
+            glProgramUniformMatrix4fv(programVisGrid, mvpVisGridLocation, 1, 0, value_ptr(mvp));
+            glProgramUniform1i(programVisGrid, grid_sizeVisGridLocation, grid_size);
+            glProgramUniform1i(programVisGrid, pointsVisGridLocation, 0);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, visFbo);
+            const GLuint noVisibility[4] = { 0, 0, 0, 0 };
+            glClearBufferuiv(GL_COLOR, 0, noVisibility);
+        }
 
-        glDisable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
+        if (gridMode == GRID_HEIGHTFIELD)
+        {
+            gridCuller.cull(mvp);
+            const vector<GLuint> & tiles = gridCuller.getVisibleTileOrigins();
+
+            glUseProgram(forwardShading ? programHeightfieldDepth : programHeightfield);
+            glBindVertexArray(patch_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, patch_vbo[2]);
+            glBufferData(GL_ARRAY_BUFFER, tiles.size() * sizeof(GLuint), tiles.empty() ? 0 : &tiles[0], GL_STREAM_DRAW);
+            glDrawElementsInstanced(GL_TRIANGLES, patch_triangleCount * 3, GL_UNSIGNED_SHORT, (void*)0, GLsizei(tiles.size()));
+        }
+        else if (gpuCulling)
+        {
+            // Reset the instance counts, then let the compute pass append
+            // every visible column to the list of its level; the draws read
+            // the counts back on the GPU. The second set is the retest.
+            GLuint levelSize = GLuint(grid_size * grid_size);
+            GLuint drawCommands[2 * 14] = {
+                GLuint(cube_triangleCount * 3), 0, 0, 0, 0,
+                6, 0, GLuint(cube_topFirstIndex), 0, levelSize,
+                1, 0, GLuint(cube_pointVertex), 2 * levelSize,
+                GLuint(cube_triangleCount * 3), 0, 0, 0, 0,
+                6, 0, GLuint(cube_topFirstIndex), 0, levelSize,
+                1, 0, GLuint(cube_pointVertex), 2 * levelSize };
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullBuffers[1]);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(drawCommands), drawCommands);
+
+            vec4 frustumPlanes[6];
+            GridCuller::getFrustumPlanes(mvp, frustumPlanes);
+            glProgramUniform4fv(programCullGrid, cullPlanesLocation, 6, value_ptr(frustumPlanes[0]));
+            glProgramUniform1i(programCullGrid, cullGridSizeLocation, grid_size);
+            glProgramUniform3fv(programCullGrid, cullCameraPosLocation, 1, value_ptr(camera.eye));
+            glProgramUniform2f(programCullGrid, cullLodDistancesLocation, lodTopDistance, lodPointDistance);
+
+            // Phase 0: frustum, then the pyramid of the last frame, seen
+            // through the matrix of the last frame
+            glProgramUniform1i(programCullGrid, cullPhaseLocation, 0);
+            glProgramUniform1i(programCullGrid, cullOcclusionLocation, occlusionCulling && hizValid);
+            glProgramUniformMatrix4fv(programCullGrid, cullHiZViewProjectionLocation, 1, 0, value_ptr(hizViewProjection));
+
+            glUseProgram(programCullGrid);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, hizTexture);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, cullBuffers[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cullBuffers[1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cullBuffers[2]);
+            glDispatchCompute((grid_size * grid_size + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+            glUseProgram(programGrid);
+            glBindVertexArray(cullVao);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, cubeMesh.getIndexType(), (void*)0, 2, 0);
+            glProgramUniform1i(programVisGrid, pointsVisGridLocation, 1);
+            glDrawArraysIndirect(GL_POINTS, (void*)(10 * sizeof(GLuint)));
+            glProgramUniform1i(programVisGrid, pointsVisGridLocation, 0);
+
+            hizValid = false;
+            if (occlusionCulling)
+            {
+                // Pyramid of the depth phase 0 drew, level 0 copies it and
+                // each next level halves the one before
+                glUseProgram(programHiZ);
+                glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
+                for (int level = 0; level < hizLevels; ++level)
+                {
+                    int levelWidth = std::max(1, width >> level);
+                    int levelHeight = std::max(1, height >> level);
+                    glProgramUniform1i(programHiZ, hizLevelLocation, level);
+                    glBindImageTexture(0, hizTexture, std::max(0, level - 1), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+                    glBindImageTexture(1, hizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+                    glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+                    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                }
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+                hizViewProjection = mvp;
+                hizValid = true;
+
+                // Phase 1: what phase 0 left out, against this frame
+                glProgramUniform1i(programCullGrid, cullPhaseLocation, 1);
+                glProgramUniformMatrix4fv(programCullGrid, cullHiZViewProjectionLocation, 1, 0, value_ptr(hizViewProjection));
+                glUseProgram(programCullGrid);
+                glBindTexture(GL_TEXTURE_2D, hizTexture);
+                glDispatchCompute((grid_size * grid_size + 63) / 64, 1, 1);
+                glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+                glUseProgram(programGrid);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, cubeMesh.getIndexType(), (void*)(14 * sizeof(GLuint)), 2, 0);
+                glProgramUniform1i(programVisGrid, pointsVisGridLocation, 1);
+                glDrawArraysIndirect(GL_POINTS, (void*)((14 + 10) * sizeof(GLuint)));
+                glProgramUniform1i(programVisGrid, pointsVisGridLocation, 0);
+            }
+            glActiveTexture(GL_TEXTURE0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            glBindVertexArray(vao);
+            if (occlusionCulling)
+            {
+#if DEBUG
+                double occlusionStart = glfwGetTime();
+#endif
+                occlusionRasterizer.begin(mvp, camera.eye);
+                gridCuller.addOccluders(occlusionRasterizer, camera.eye, currentTime, occluderDistance);
+                occlusionRasterizer.rasterize();
+#if DEBUG
+                occlusionTime = glfwGetTime() - occlusionStart;
+#endif
+            }
+            gridCuller.cull(mvp, camera.eye, occlusionCulling ? &occlusionRasterizer : 0);
+            drawGridRuns();
+        }
 
-        // Select textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
+        if (visibilityGrid)
+        {
+            // Resolve: rebuild and shade the surface under each id into the
+            // gbuffer color and normal, the depth is already there
+            glProgramUniformMatrix4fv(programVisResolve, inverseMvpVisResolveLocation, 1, 0, value_ptr(inverse(mvp)));
+            glProgramUniformMatrix4fv(programVisResolve, mvVisResolveLocation, 1, 0, value_ptr(mv));
+            glProgramUniform1i(programVisResolve, grid_sizeVisResolveLocation, grid_size);
+            glProgramUniform1f(programVisResolve, brightnessVisResolveLocation, brightness);
+            glProgramUniform1f(programVisResolve, attenuationVisResolveLocation, attenuation);
+            glProgramUniform3fv(programVisResolve, cameraPosVisResolveLocation, 1, value_ptr(camera.eye));
+
+            glBindFramebuffer(GL_FRAMEBUFFER, gbufferFbo);
+            glDisable(GL_DEPTH_TEST);
+            glUseProgram(programVisResolve);
+            glBindTexture(GL_TEXTURE_2D, visTexture);
+            glBindVertexArray(quad_vao);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            glEnable(GL_DEPTH_TEST);
+        }
 
-        glBindVertexArray(quad_vao);
+        // Sphere
 
+        glUseProgram(forwardShading ? programSphereDepth : programSphere);
 
-        /**************
-         * Light Render
-         *************/
+        glBindVertexArray(sphere_vao);
+        glDrawElements(GL_TRIANGLES, sphereMesh.getIndexCount(), sphereMesh.getIndexType(), NULL);
+#if DEBUG
+        glEndQuery(GL_TIME_ELAPSED);
+#endif
 
-        // Render directional lights
-        glUseProgram(programDirLight);
-        struct DirectionalLight
-        {
-            vec3 direction;
-            int padding;
-            vec3 color;
-            float intensity;
-        };
-        for (int i = 0; i < directionalLightCount; ++i)
+        // Lights, written at once for the whole frame
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
+        unsigned char * lightBuffer = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        DirectionalLight * directionalLights = (DirectionalLight *) lightBuffer;
+        for (int i = 0; i < activeDirectionalLightCount; ++i)
         {
-            glBindBuffer(GL_UNIFORM_BUFFER, ubo[0]);
             DirectionalLight d = {
                     vec3(directionalLightDir), 0,
                     directionalLightColor,
                     directionalLightIntensity
             };
-            DirectionalLight * directionalLightBuffer = (DirectionalLight *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, uboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-            *directionalLightBuffer = d;
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-            glBindBufferBase(GL_UNIFORM_BUFFER, (GLuint) directionallightLightLocation, ubo[0]);
-            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+            directionalLights[i] = d;
         }
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo[0]);
 
-        glUseProgram(programBlit);
+        // Point lights in a square around the column under the sphere, one
+        // unit above the top of their column, then binned by view cluster
+#if DEBUG
+        double clusterStart = glfwGetTime();
+#endif
+        int lightSide = int(std::ceil(std::sqrt(float(activePointLightCount))));
+        int centerX = int(std::floor(camera.o.x / cubeSpacing + 0.5f)) + grid_size / 2;
+        int centerZ = int(std::floor(camera.o.z / cubeSpacing + 0.5f)) + grid_size / 2;
+        pointLights.resize(activePointLightCount * 2);
+        viewSpheres.resize(activePointLightCount);
+        for (int i = 0; i < activePointLightCount; ++i)
+        {
+            int x = centerX + (i % lightSide - lightSide / 2) * 2;
+            int z = centerZ + (i / lightSide - lightSide / 2) * 2;
+            float top = 0.f;
+            if (x >= 0 && x < grid_size && z >= 0 && z < grid_size)
+                top = ColumnHeights::height(z * grid_size + x, grid_size, currentTime, camera.eye);
+            vec3 position((x - grid_size / 2) * cubeSpacing, top + 1.f, (z - grid_size / 2) * cubeSpacing);
+            viewSpheres[i] = vec4(vec3(mv * vec4(position, 1.f)), pointLightRadius);
+            pointLights[i * 2] = viewSpheres[i];
+            pointLights[i * 2 + 1] = vec4(mix(colorNear, colorFar, float(i) / activePointLightCount) * pointLightIntensity, 0.f);
+        }
+        lightClusters.build(viewSpheres);
+#if DEBUG
+        clusterTime = glfwGetTime() - clusterStart;
+#endif
+
+        // Empty lists still get one element, a buffer texture needs storage
+        const void * lightData[3] = { pointLights.empty() ? 0 : &pointLights[0], &lightClusters.getClusters()[0],
+                                      lightClusters.getLightIndices().empty() ? 0 : &lightClusters.getLightIndices()[0] };
+        size_t lightSizes[3] = { pointLights.size() * sizeof(vec4), lightClusters.getClusters().size() * sizeof(GLuint),
+                                 lightClusters.getLightIndices().size() * sizeof(GLuint) };
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, lightBuffers[i]);
+            if (lightSizes[i])
+                glBufferData(GL_TEXTURE_BUFFER, lightSizes[i], lightData[i], GL_STREAM_DRAW);
+            else
+                glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4), 0, GL_STREAM_DRAW);
+            glActiveTexture(GL_TEXTURE5 + i);
+            glBindTexture(GL_TEXTURE_BUFFER, lightTextures[i]);
+        }
         glActiveTexture(GL_TEXTURE0);
-        glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-        glDisable(GL_BLEND);
+        if (forwardShading)
+        {
+            // Shading pass: the same draws over the prepass depth, only the
+            // nearest fragment of each pixel passes and gets lit
+#if DEBUG
+            glBeginQuery(GL_TIME_ELAPSED, frameQueries[1]);
+#endif
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+
+            if (gridMode == GRID_HEIGHTFIELD)
+            {
+                glUseProgram(programHeightfieldForward);
+                glBindVertexArray(patch_vao);
+                glDrawElementsInstanced(GL_TRIANGLES, patch_triangleCount * 3, GL_UNSIGNED_SHORT, (void*)0, GLsizei(gridCuller.getVisibleTileOrigins().size()));
+            }
+            else if (gpuCulling)
+            {
+                // The lists of both culling phases are still in the buffers
+                glUseProgram(programCubeGridForward);
+                glBindVertexArray(cullVao);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullBuffers[1]);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, cubeMesh.getIndexType(), (void*)0, 2, 0);
+                glDrawArraysIndirect(GL_POINTS, (void*)(10 * sizeof(GLuint)));
+                if (occlusionCulling)
+                {
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, cubeMesh.getIndexType(), (void*)(14 * sizeof(GLuint)), 2, 0);
+                    glDrawArraysIndirect(GL_POINTS, (void*)((14 + 10) * sizeof(GLuint)));
+                }
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            }
+            else
+            {
+                glUseProgram(programCubeGridForward);
+                glBindVertexArray(vao);
+                drawGridRuns();
+            }
+
+            glUseProgram(programSphereForward);
+            glBindVertexArray(sphere_vao);
+            glDrawElements(GL_TRIANGLES, sphereMesh.getIndexCount(), sphereMesh.getIndexType(), NULL);
+
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+#if DEBUG
+            glEndQuery(GL_TIME_ELAPSED);
+#endif
+
+            glDisable(GL_DEPTH_TEST);
+            glBindFramebuffer(GL_FRAMEBUFFER, fxFbo);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fxFbo);
+            // Attach first fx texture to framebuffer
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 , GL_TEXTURE_2D, fxTextures[0], 0);
+
+            glDisable(GL_DEPTH_TEST);
+
+            // Select textures
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gbufferTextures[1]);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, gbufferTextures[2]);
+
+            glBindVertexArray(quad_vao);
+
+
+            /**************
+             * Light Render
+             *************/
+
+            // Every light in one pass over the screen, which also writes the
+            // surface color, so nothing is blended
+#if DEBUG
+            glBeginQuery(GL_TIME_ELAPSED, frameQueries[1]);
+#endif
+            glUseProgram(programDirLight);
+            glDrawElements(GL_TRIANGLES, quad_triangleCount * 3, GL_UNSIGNED_INT, (void*)0);
+#if DEBUG
+            glEndQuery(GL_TIME_ELAPSED);
+#endif
+        }
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, gbufferTextures[0]);
@@ -946,7 +1818,10 @@ int main(void)
         ImGui::Text("Grid Size");
         ImGui::RadioButton("10", &grid_size, 10); ImGui::SameLine();
         ImGui::RadioButton("100", &grid_size, 100); ImGui::SameLine();
-        ImGui::RadioButton("1000", &grid_size, 1000);
+        ImGui::RadioButton("1000", &grid_size, 1000); ImGui::SameLine();
+        ImGui::RadioButton("2000", &grid_size, 2000);
+        ImGui::RadioButton("Cubes", &gridMode, GRID_CUBES); ImGui::SameLine();
+        ImGui::RadioButton("Heightfield", &gridMode, GRID_HEIGHTFIELD);
         ImGui::Text("Grid Shader");
         ImGui::ColorEdit3("colorNear", value_ptr(colorNear));
         ImGui::ColorEdit3("colorFar", value_ptr(colorFar));
@@ -956,6 +1831,13 @@ int main(void)
         ImGui::ColorEdit3("Dir Light color", value_ptr(directionalLightColor));
         ImGui::SliderFloat3("Dir light dir", value_ptr(directionalLightDir), -1.f, 1.f);
         ImGui::SliderFloat("Dir Light Intensity", &directionalLightIntensity, 0.f, 5.f);
+        ImGui::SliderInt("Dir lights", &directionalLightCount, 1, MAX_DIRECTIONAL_LIGHTS);
+        ImGui::Text("Point lights");
+        ImGui::SliderInt("Point light count", &pointLightCount, 0, MAX_POINT_LIGHTS);
+        ImGui::SliderFloat("Point light intensity", &pointLightIntensity, 0.f, 10.f);
+        ImGui::SliderFloat("Point light radius", &pointLightRadius, 1.f, 50.f);
+        ImGui::Text("Clusters: %d lights, %d assignments, max %d, %.2f ms", std::min(pointLightCount, MAX_POINT_LIGHTS),
+                    int(lightClusters.getLightIndices().size()), lightClusters.getMaxClusterLightCount(), clusterTime * 1000.0);
         ImGui::Text("FX");
         ImGui::SliderFloat("Gamma", &gamma, 0.01f, 3.0f);
         ImGui::SliderFloat("Focus plane", &focusPlane, 1.f, 100.f);
@@ -964,6 +1846,43 @@ int main(void)
         ImGui::DragInt("Sample Count", &sampleCount, .1f, 0, 100);
 
         ImGui::ColorEdit3("colorSphere", value_ptr(sphereColor));
+        if (hasGpuCulling)
+            ImGui::Checkbox("GPU culling", &gpuCulling);
+        ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+        if (!gpuCulling)
+            ImGui::SliderFloat("Occluder distance", &occluderDistance, 4.f, 200.f);
+        ImGui::Checkbox("Compact vertices", &compactVertices);
+        ImGui::Text("Vertices: cube %d + %d bytes, sphere %d + %d bytes", cubeMesh.getVertexBytes(), cubeMesh.getIndexBytes(),
+                    sphereMesh.getVertexBytes(), sphereMesh.getIndexBytes());
+        ImGui::Text("ACMR: cube %.3f, sphere %.3f", cubeMesh.getAcmr(), sphereMesh.getAcmr());
+        ImGui::Checkbox("Forward shading", &forwardShading);
+        if (forwardShading)
+            ImGui::Text("Forward: depth prepass %.2f ms, shading %.2f ms", gbufferPassTime, lightingPassTime);
+        else
+            ImGui::Text("Gbuffer: %d bytes/pixel, %.2f ms, lighting %.2f ms", gbufferBytesPerPixel, gbufferPassTime, lightingPassTime);
+        if (visibilityBuffer && gridMode == GRID_CUBES && !forwardShading)
+            ImGui::Text("Visibility buffer: grid ids 4 bytes/pixel, shaded once per pixel");
+        ImGui::SliderFloat("LOD top face (px)", &lodTopSize, 1.f, 64.f);
+        ImGui::SliderFloat("LOD point (px)", &lodPointSize, 0.25f, 8.f);
+        if (gridMode == GRID_HEIGHTFIELD)
+            ImGui::Text("Heightfield: %d / %d tiles, %d triangles", gridCuller.getVisibleTileCount(), gridCuller.getTileCount(),
+                        gridCuller.getVisibleTileCount() * patch_triangleCount);
+        else if (gpuCulling)
+            ImGui::Text(occlusionCulling ? "Culling: compute pass, Hi-Z retest, indirect draw" : "Culling: compute pass, indirect draw");
+        else
+        {
+            ImGui::Text("Culling: %d / %d tiles, %d / %d cubes, %d draws", gridCuller.getVisibleTileCount(), gridCuller.getTileCount(),
+                        gridCuller.getVisibleInstanceCount(), grid_size * grid_size, int(gridCuller.getRuns().size()));
+            ImGui::Text("LOD: %d cubes, %d tops, %d points", gridCuller.getVisibleInstanceCount(GridCuller::LOD_CUBE),
+                        gridCuller.getVisibleInstanceCount(GridCuller::LOD_TOP), gridCuller.getVisibleInstanceCount(GridCuller::LOD_POINT));
+            if (occlusionCulling)
+            {
+                int frustumTiles = gridCuller.getVisibleTileCount() + gridCuller.getOccludedTileCount();
+                ImGui::Text("Occlusion: %d / %d tiles culled (%.0f%%), %d triangles, %.2f ms", gridCuller.getOccludedTileCount(), frustumTiles,
+                            frustumTiles ? 100.f * gridCuller.getOccludedTileCount() / frustumTiles : 0.f,
+                            occlusionRasterizer.getTriangleCount(), occlusionTime * 1000.0);
+            }
+        }
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
         ImGui::End();
 
@@ -1070,19 +1989,47 @@ GLuint compile_shader(GLenum shaderType, const char * sourceBuffer, int bufferSi
     return shaderObject;
 }
 
-GLuint compile_shader_from_file(GLenum shaderType, const char * path)
+static bool read_shader_file(const char * path, string & source)
 {
     FILE * shaderFileDesc = fopen( path, "rb" );
     if (!shaderFileDesc)
-        return 0;
+        return false;
     fseek ( shaderFileDesc , 0 , SEEK_END );
     long fileSize = ftell ( shaderFileDesc );
     rewind ( shaderFileDesc );
     char * buffer = new char[fileSize + 1];
     fread( buffer, 1, fileSize, shaderFileDesc );
     buffer[fileSize] = '\0';
-    GLuint shaderObject = compile_shader(shaderType, buffer, fileSize );
+    fclose( shaderFileDesc );
+    source = buffer;
     delete[] buffer;
+    return true;
+}
+
+GLuint compile_shader_from_file(GLenum shaderType, const char * path, const char * defines, const char * const * includePaths)
+{
+    string source;
+    if (!read_shader_file(path, source))
+        return 0;
+    string prefix = defines ? defines : "";
+    int includeCount = 0;
+    for (; includePaths && includePaths[includeCount]; ++includeCount)
+    {
+        string include;
+        if (!read_shader_file(includePaths[includeCount], include))
+            return 0;
+        // messages in include i report source string i + 1
+        prefix += "#line 1 " + to_string(includeCount + 1) + "\n" + include + "\n";
+    }
+    if (includeCount)
+        prefix += "#line 2 0\n";
+    else if (defines)
+        prefix += "#line 2\n";
+    // #line keeps compiler messages on the lines of the file
+    size_t versionEnd = source.find('\n');
+    if (!prefix.empty() && versionEnd != string::npos)
+        source.insert(versionEnd + 1, prefix);
+    GLuint shaderObject = compile_shader(shaderType, source.c_str(), int(source.size()));
     return shaderObject;
 }
 
@@ -1183,21 +2130,3 @@ void init_gui_states(GUIStates & guiStates)
     guiStates.time = 0.0;
     guiStates.playing = false;
 }
-
-float angleBetween(vec3 a, vec3 b, vec3 ref)
-{
-    /*
-    float dot = a.x * b.x + a.y * b.y + a.z * b.z;
-    float lenSq1 = a.x * a.x + a.y * a.y + a.z * a.z;
-    float lenSq2 = b.x * b.x + b.y * b.y + b.z * b.z;
-    return acos(dot/sqrt(lenSq1 * lenSq2));
-     */
-
-    float angle = acos(dot(normalize(a), normalize(b)));
-    vec3 crossProduct = cross(a, b);
-    if (float(dot(ref, crossProduct)) < 0.0) { // Or > 0
-        angle = -angle;
-    }
-
-    return angle;
-}
\ No newline at end of file
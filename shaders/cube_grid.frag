@@ -7,12 +7,12 @@
 
 precision highp int;
 
-uniform vec3 colorNear;
-uniform vec3 colorFar;
-uniform int grid_size;
 uniform float brightness;
 uniform float attenuation;
+#ifndef FORWARD
+// lighting.glsl declares it in the forward variant
 uniform mat4 MV;
+#endif
 uniform vec3 lightDir;
 uniform vec3 camPos;
 
@@ -27,6 +27,7 @@ in block
 	vec3 CameraSpacePosition;
     vec3 CameraSpaceNormal;
     vec3 wPosition;
+    flat vec3 Color;
 } In;
 
 vec3 applyFog(vec3  rgb, float distance, vec3  rayOri, vec3  rayDir )
@@ -36,19 +37,11 @@ vec3 applyFog(vec3  rgb, float distance, vec3  rayOri, vec3  rayDir )
     return mix( rgb, fogColor, fogAmount );
 }
 
-vec3 getColor()
-{
-    float halfGrid = grid_size * 0.5;
-    float ratio = distance(vec3(-halfGrid, 5, -halfGrid), In.wPosition) / grid_size;
-    ratio = max(min(ratio, 1.0), 0.0);
-    return colorFar * ratio + colorNear * (1.0 - ratio);
-}
-
 void main()
 {
-    vec2 multiplier = pow( abs( In.Texcoord - 0.5 ), vec2( attenuation ) );
+    vec2 multiplier = pow( abs( fract( In.Texcoord ) - 0.5 ), vec2( attenuation ) );
 
-    vec3 colorShaded = getColor() * brightness * length( multiplier );
+    vec3 colorShaded = In.Color * brightness * length( multiplier );
     float camToPointDist = distance(In.wPosition, camPos);
     vec3 rayDir = normalize(In.wPosition - camPos);
     vec3 sunDir = vec3(MV * vec4(lightDir, 0.f));
@@ -56,6 +49,15 @@ void main()
     vec3  diffuseColor = vec3(0.5f);
     float specularColor = 0.5f;
 
-    FragColor = vec4(applyFog(colorShaded, camToPointDist, camPos, rayDir) , specularColor);
-    Normal = vec4( normalize(In.CameraSpaceNormal), 15.f);
+    vec3 color = applyFog(colorShaded, camToPointDist, camPos, rayDir);
+#ifdef FORWARD
+    // Clamped as the gbuffer color target would store it
+    vec3 n = normalize(In.CameraSpaceNormal);
+    vec3 v = normalize(-In.CameraSpacePosition);
+    color = clamp(color, 0.0, 1.0);
+    FragColor = vec4(color + lighting(In.CameraSpacePosition, n, v, color, vec3(specularColor), 15.f), 1.0);
+#else
+    FragColor = vec4(color, specularColor);
+    Normal = encodeNormal(normalize(In.CameraSpaceNormal), 15.f);
+#endif
 }
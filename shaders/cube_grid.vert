@@ -3,6 +3,7 @@
 #define POSITION	0
 #define NORMAL		1
 #define TEXCOORD	2
+#define COLUMN		3
 #define FRAG_COLOR	0
 
 precision highp float;
@@ -10,13 +11,15 @@ precision highp int;
 
 uniform mat4 MV;
 uniform mat4 MVP;
-uniform vec3 camPos;
 uniform int grid_size;
-uniform float time;
+// Per column color and height scale from cube_columns.vert
+uniform samplerBuffer Columns;
 
 layout(location = POSITION) in vec3 Position;
 layout(location = NORMAL) in vec3 Normal;
 layout(location = TEXCOORD) in vec2 Texcoord;
+// z * grid_size + x, one per instance, from the culled tile list
+layout(location = COLUMN) in uint Column;
 
 out block
 {
@@ -24,91 +27,62 @@ out block
 	vec3 CameraSpacePosition;
     vec3 CameraSpaceNormal;
     vec3 wPosition;
-
+    flat vec3 Color;
 } Out;
+// Column of the instance, for the visibility buffer
+flat out uint ColumnIndex;
 
-vec3 mod289(vec3 x) {
-  return x - floor(x * (1.0 / 289.0)) * 289.0;
-}
-
-vec2 mod289(vec2 x) {
-  return x - floor(x * (1.0 / 289.0)) * 289.0;
-}
-
-vec3 permute(vec3 x) {
-  return mod289(((x*34.0)+1.0)*x);
-}
-
-float snoise(vec2 v)
-  {
-  const vec4 C = vec4(0.211324865405187,
-                      0.366025403784439,
-                     -0.577350269189626,
-                      0.024390243902439);
-// First corner
-  vec2 i  = floor(v + dot(v, C.yy) );
-  vec2 x0 = v -   i + dot(i, C.xx);
-
-// Other corners
-  vec2 i1;
-  i1 = (x0.x > x0.y) ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
-  vec4 x12 = x0.xyxy + C.xxzz;
-  x12.xy -= i1;
-
-// Permutations
-  i = mod289(i); // Avoid truncation effects in permutation
-  vec3 p = permute( permute( i.y + vec3(0.0, i1.y, 1.0 ))
-		+ i.x + vec3(0.0, i1.x, 1.0 ));
+// The depth prepass and the forward pass must land on the same depth
+invariant gl_Position;
 
-  vec3 m = max(0.5 - vec3(dot(x0,x0), dot(x12.xy,x12.xy), dot(x12.zw,x12.zw)), 0.0);
-  m = m*m ;
-  m = m*m ;
-
-// Gradients: 41 points uniformly over a line, mapped onto a diamond.
-
-  vec3 x = 2.0 * fract(p * C.www) - 1.0;
-  vec3 h = abs(x) - 0.5;
-  vec3 ox = floor(x + 0.5);
-  vec3 a0 = x - ox;
-
-// Normalise gradients implicitly by scaling m
-// Approximation of: m *= inversesqrt( a0*a0 + h*h );
-  m *= 1.79284291400159 - 0.85373472095314 * ( a0*a0 + h*h );
-
-// Compute final noise value at P
-  vec3 g;
-  g.x  = a0.x  * x0.x  + h.x  * x0.y;
-  g.yz = a0.yz * x12.xz + h.yz * x12.yw;
-  return 130.0 * dot(m, g);
+// Height of a column, 0 outside the grid
+float columnHeight(ivec2 cell)
+{
+    if (any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(grid_size))))
+        return 0.0;
+    return texelFetch(Columns, cell.y * grid_size + cell.x).a;
 }
 
-
 void main()
 {
     vec3 p = Position;
-    float camDist = 15.f;
+    vec2 texcoord = Texcoord;
+    int column = int(Column);
+    vec4 instance = texelFetch(Columns, column);
 
-    float translateX = (gl_InstanceID % grid_size) - (grid_size / 2);
-    float translateZ = (gl_InstanceID / grid_size) - (grid_size / 2);
+    float translateX = (column % grid_size) - (grid_size / 2);
+    float translateZ = (column / grid_size) - (grid_size / 2);
 
     p.x += translateX;
     p.z += translateZ;
 
-    float noise = snoise(vec2((gl_InstanceID % grid_size) - (grid_size / 2) * time * 0.001, (gl_InstanceID / grid_size) - (grid_size / 2)));
-    if (noise < 0.f) {noise = - noise;}
-
-    if (distance(vec3(translateX * 2, 10.f * noise, translateZ * 2), camPos) > camDist){
-
-        p.y *= 10.f * noise;
+    p.y *= instance.a;
+
+    // Only what is exposed gets rasterized: a side face starts at the
+    // height of the neighbour it faces, and collapses to a line when that
+    // neighbour is as tall. u runs up side faces, so moving it with the
+    // bottom edge keeps the pattern in place. The bottom face is never
+    // seen and collapses to a point.
+    ivec2 cell = ivec2(column % grid_size, column / grid_size);
+    if (Normal.y < 0.0)
+    {
+        p = vec3(0.0);
+    }
+    else if (Normal.y == 0.0 && Position.y == 0.0)
+    {
+        p.y = min(columnHeight(cell + ivec2(Normal.xz)), instance.a);
+        texcoord.x = instance.a > 0.0 ? p.y / instance.a : 0.0;
     }
 
     p.x *= 2;
     p.z *= 2;
 
-    Out.Texcoord = Texcoord;
+    Out.Texcoord = texcoord;
     Out.CameraSpacePosition = vec3(MV * vec4(p, 1.0));
     Out.CameraSpaceNormal = vec3(MV * vec4(Normal, 0.0));
     Out.wPosition = p;
+    Out.Color = instance.rgb;
+    ColumnIndex = Column;
 
 	gl_Position = MVP * vec4(p, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+// Layout of the gbuffer normal target, prepended after the defines to the
+// shaders that write it and to dirLight.frag that reads it, by
+// compile_shader_from_file, so the writers and the reader always agree.
+// Full: view space normal in rgb, specular power in a.
+// COMPACT_GBUFFER: octahedron encoded normal in rg, scaled specular power in b.
+
+#ifdef COMPACT_GBUFFER
+// Specular power is stored divided by this, in the blue channel
+#define SPECULAR_POWER_SCALE    64.0
+
+// Unit vector to the octahedron unfolded on [0, 1]^2
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+// Inverse of octEncode()
+vec3 octDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
+
+// Normal target texel of a unit view space normal
+vec4 encodeNormal(vec3 n, float specularPower)
+{
+#ifdef COMPACT_GBUFFER
+    return vec4(octEncode(n), specularPower / SPECULAR_POWER_SCALE, 0.0);
+#else
+    return vec4(n, specularPower);
+#endif
+}
+
+// Unit view space normal and specular power of a normal target texel
+void decodeNormal(vec4 texel, out vec3 n, out float specularPower)
+{
+#ifdef COMPACT_GBUFFER
+    n = octDecode(texel.rg);
+    specularPower = texel.b * SPECULAR_POWER_SCALE;
+#else
+    n = texel.rgb;
+    specularPower = texel.a;
+#endif
+}
@@ -0,0 +1,73 @@
+#version 410 core
+
+#define POSITION	0
+#define TILE		3
+#define FRAG_COLOR	0
+
+precision highp float;
+precision highp int;
+
+uniform mat4 MV;
+uniform mat4 MVP;
+uniform int grid_size;
+// Per column color and height scale from cube_columns.vert
+uniform samplerBuffer Columns;
+
+// Corner of a patch, in columns from the patch corner
+layout(location = POSITION) in uvec2 Position;
+// z * grid_size + x of the first column of the patch, one per instance
+layout(location = TILE) in uint Tile;
+
+out block
+{
+	vec2 Texcoord;
+	vec3 CameraSpacePosition;
+    vec3 CameraSpaceNormal;
+    vec3 wPosition;
+    flat vec3 Color;
+} Out;
+
+// The depth prepass and the forward pass must land on the same depth
+invariant gl_Position;
+
+vec4 column(ivec2 cell)
+{
+    cell = clamp(cell, ivec2(0), ivec2(grid_size - 1));
+    return texelFetch(Columns, cell.y * grid_size + cell.x);
+}
+
+void main()
+{
+    // Vertices sit on column corners, so each column is one quad with the
+    // footprint of a cube top. A corner takes the mean of the four columns
+    // around it; corners past the last column clamp onto it.
+    ivec2 corner = ivec2(int(Tile) % grid_size, int(Tile) / grid_size) + ivec2(Position);
+    // Every tile draws a whole patch. On the last row and column of tiles
+    // of a grid that is not a multiple of the patch size, the corners past
+    // the grid edge collapse onto it, so their quads have no area.
+    corner = min(corner, ivec2(grid_size));
+    vec4 a = column(corner - ivec2(1, 1));
+    vec4 b = column(corner - ivec2(0, 1));
+    vec4 c = column(corner - ivec2(1, 0));
+    vec4 d = column(corner);
+    vec4 instance = (a + b + c + d) * 0.25;
+
+    vec3 p = vec3(corner.x - grid_size / 2 - 0.5, instance.a, corner.y - grid_size / 2 - 0.5);
+    p.x *= 2;
+    p.z *= 2;
+
+    // Slope across the four columns, two units apart
+    float dx = (b.a + d.a - a.a - c.a) * 0.25;
+    float dz = (c.a + d.a - a.a - b.a) * 0.25;
+    vec3 normal = normalize(vec3(-dx, 1.0, -dz));
+
+    // Integer on column borders, fract() in cube_grid.frag gives the
+    // same 0 to 1 range a cube face has
+    Out.Texcoord = vec2(corner);
+    Out.CameraSpacePosition = vec3(MV * vec4(p, 1.0));
+    Out.CameraSpaceNormal = vec3(MV * vec4(normal, 0.0));
+    Out.wPosition = p;
+    Out.Color = instance.rgb;
+
+	gl_Position = MVP * vec4(p, 1.0);
+}
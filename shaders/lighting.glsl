@@ -0,0 +1,71 @@
+// Lights of the deferred and forward shading, prepended after the defines
+// to dirLight.frag and to the FORWARD cube_grid.frag and sphere.frag by
+// compile_shader_from_file, so both paths light surfaces the same way
+
+// World to view, the light directions are in world space
+uniform mat4 MV;
+
+#define MAX_DIRECTIONAL_LIGHTS  16
+
+struct DirectionalLight
+{
+    vec3 Direction;
+    vec3 Color;
+    float Intensity;
+};
+
+// Directional lights of the frame, in world space, uploaded once per frame.
+// std140 fixes the 32 byte stride the DirectionalLight of main.cpp writes.
+layout(std140) uniform lights
+{
+    DirectionalLight DirectionalLights[MAX_DIRECTIONAL_LIGHTS];
+};
+uniform int directionalLightCount;
+
+// Point lights in view space, two texels each: center and radius, then
+// color times intensity
+uniform samplerBuffer PointLights;
+// Offset in LightIndices and light count of each cluster, see LightClusters
+uniform usamplerBuffer LightClusters;
+uniform usamplerBuffer LightIndices;
+// Tiles across, tiles up and depth slices
+uniform ivec3 clusterCount;
+// Tiles per pixel
+uniform vec2 clusterTileScale;
+// Slice of view depth d is log(d) * x + y
+uniform vec2 clusterSlice;
+
+vec3 blinnPhong(vec3 l, vec3 n, vec3 v, vec3 diffuseColor, vec3 specularColor, float specularPower)
+{
+    float ndotl = max(dot(n, l), 0.0);
+    vec3 h = normalize(l + v);
+    float ndoth = max(dot(n, h), 0.0);
+    return diffuseColor * ndotl + specularColor * pow(ndoth, specularPower);
+}
+
+// Sum of every light at the view space position p
+vec3 lighting(vec3 p, vec3 n, vec3 v, vec3 diffuseColor, vec3 specularColor, float specularPower)
+{
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < directionalLightCount; ++i)
+    {
+        vec3 l = normalize(-vec3(MV * vec4(DirectionalLights[i].Direction, 0.0)));
+        color += DirectionalLights[i].Color * DirectionalLights[i].Intensity * blinnPhong(l, n, v, diffuseColor, specularColor, specularPower);
+    }
+    // Only the point lights binned in the cluster of the pixel, they fade
+    // out to 0 at their radius
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), clusterCount.xy - 1);
+    int slice = clamp(int(floor(log(-p.z) * clusterSlice.x + clusterSlice.y)), 0, clusterCount.z - 1);
+    uvec2 cluster = texelFetch(LightClusters, (slice * clusterCount.y + tile.y) * clusterCount.x + tile.x).rg;
+    for (uint i = 0u; i < cluster.y; ++i)
+    {
+        int light = int(texelFetch(LightIndices, int(cluster.x + i)).r);
+        vec4 sphere = texelFetch(PointLights, light * 2);
+        vec3 toLight = sphere.xyz - p;
+        float lightDistance = length(toLight);
+        float falloff = max(1.0 - lightDistance / sphere.w, 0.0);
+        if (falloff > 0.0)
+            color += texelFetch(PointLights, light * 2 + 1).rgb * falloff * falloff * blinnPhong(toLight / lightDistance, n, v, diffuseColor, specularColor, specularPower);
+    }
+    return color;
+}
@@ -26,6 +26,10 @@ void main() {
     vec3 eye = normalize( -In.Position.xyz );
     float rim = smoothstep( start, end, 1.0 - dot( normal, eye ) );
     float value = clamp( rim * alpha, 0.0, 1.0 );
+#ifdef FORWARD
+    FragColor = vec4( Color + lighting(In.Position, normal, eye, Color, vec3(0.5f), 15.f), 1.0 );
+#else
     FragColor = vec4( Color, 0.5f );
-    Normal = vec4( normalize(In.Normal), 15.f);
+    Normal = encodeNormal(normal, 15.f);
+#endif
 }
@@ -23,13 +23,16 @@ out block
 	vec3 Normal;
 } Out;
 
+// The depth prepass and the forward pass must land on the same depth
+invariant gl_Position;
+
 void main()
 {
-  Out.Normal = normalize((MV * vec4(Normal, 0.0)).xyz);
-  Out.Position = (MV * vec4(Position, 1.0)).xyz;
-
   vec3 pos = Position * 0.2f;
   pos += position_scripted;
   //pos *= 5.f;
+
+  Out.Normal = normalize((MV * vec4(Normal, 0.0)).xyz);
+  Out.Position = (MV * vec4(pos, 1.0)).xyz;
   gl_Position = MVP * vec4(pos, 1.0);
 }
\ No newline at end of file
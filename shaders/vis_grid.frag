@@ -0,0 +1,50 @@
+#version 410 core
+
+#define VISIBILITY	0
+
+// Face codes, the cube face a pixel shows, or a column drawn as a point
+#define FACE_POS_X	0u
+#define FACE_NEG_X	1u
+#define FACE_POS_Y	2u
+#define FACE_NEG_Y	3u
+#define FACE_POS_Z	4u
+#define FACE_NEG_Z	5u
+#define FACE_POINT	6u
+
+precision highp int;
+
+uniform mat4 MV;
+// Set while the LOD_POINT columns are drawn
+uniform bool points;
+
+// (column << 3 | face) + 1, 0 is left where nothing was drawn
+layout(location = VISIBILITY) out uint Visibility;
+
+in block
+{
+	vec2 Texcoord;
+	vec3 CameraSpacePosition;
+    vec3 CameraSpaceNormal;
+    vec3 wPosition;
+    flat vec3 Color;
+} In;
+
+flat in uint ColumnIndex;
+
+void main()
+{
+    // MV is a rotation and a translation, its transpose takes the normal back
+    vec3 n = transpose(mat3(MV)) * In.CameraSpaceNormal;
+    vec3 a = abs(n);
+    uint face;
+    if (points)
+        face = FACE_POINT;
+    else if (a.x >= a.y && a.x >= a.z)
+        face = n.x >= 0.0 ? FACE_POS_X : FACE_NEG_X;
+    else if (a.y >= a.z)
+        face = n.y >= 0.0 ? FACE_POS_Y : FACE_NEG_Y;
+    else
+        face = n.z >= 0.0 ? FACE_POS_Z : FACE_NEG_Z;
+
+    Visibility = (ColumnIndex << 3 | face) + 1u;
+}
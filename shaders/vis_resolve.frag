@@ -0,0 +1,106 @@
+#version 410 core
+
+#define FRAG_COLOR	0
+#define NORMAL		1
+
+// Face codes of vis_grid.frag
+#define FACE_POS_X	0u
+#define FACE_NEG_X	1u
+#define FACE_POS_Y	2u
+#define FACE_NEG_Y	3u
+#define FACE_POS_Z	4u
+#define FACE_NEG_Z	5u
+#define FACE_POINT	6u
+
+precision highp float;
+precision highp int;
+
+in block
+{
+	vec2 Texcoord;
+} In;
+
+uniform usampler2D Visibility;
+// Per column color and height scale from cube_columns.vert
+uniform samplerBuffer Columns;
+uniform int grid_size;
+
+uniform mat4 MV;
+uniform mat4 InverseMVP;
+uniform vec3 camPos;
+uniform float brightness;
+uniform float attenuation;
+
+// Same outputs as cube_grid.frag, into the gbuffer
+layout(location = FRAG_COLOR, index = 0) out vec4 FragColor;
+layout(location = NORMAL) out vec4 Normal;
+
+const float b = 0.01;
+
+vec3 applyFog(vec3  rgb, float distance, vec3  rayOri, vec3  rayDir )
+{
+    float fogAmount = 1.5 * exp(-rayOri.y*b) * (1.0-exp( -distance*rayDir.y*b ))/rayDir.y;
+    vec3  fogColor  = vec3(0.f);
+    return mix( rgb, fogColor, fogAmount );
+}
+
+void main()
+{
+    uint visibility = texelFetch(Visibility, ivec2(gl_FragCoord.xy), 0).r;
+    if (visibility == 0u)
+        discard;
+    int column = int((visibility - 1u) >> 3);
+    uint face = (visibility - 1u) & 7u;
+
+    vec4 instance = texelFetch(Columns, column);
+    vec2 center = vec2(column % grid_size - grid_size / 2, column / grid_size - grid_size / 2) * 2.0;
+
+    // The pixel lies on a known face plane, so its position is where the
+    // view ray meets that plane, exact whatever the depth precision
+    vec3 normal;
+    vec3 p;
+    if (face == FACE_POINT)
+    {
+        normal = vec3(0.0, 1.0, 0.0);
+        p = vec3(center.x, instance.a, center.y);
+    }
+    else
+    {
+        vec2 ndc = In.Texcoord * 2.0 - 1.0;
+        vec4 nearPoint = InverseMVP * vec4(ndc, -1.0, 1.0);
+        vec4 farPoint = InverseMVP * vec4(ndc, 1.0, 1.0);
+        vec3 rayDir = normalize(farPoint.xyz / farPoint.w - nearPoint.xyz / nearPoint.w);
+
+        float sign = (face & 1u) == 0u ? 1.0 : -1.0;
+        uint axis = face >> 1;
+        normal = vec3(0.0);
+        normal[axis] = sign;
+        vec3 planePoint = vec3(center.x, instance.a, center.y) + vec3(sign, 0.0, sign);
+        float t = dot(normal, planePoint - camPos) / dot(normal, rayDir);
+        p = camPos + rayDir * t;
+    }
+
+    // uv as cube_grid.vert sets it: u runs up the side faces, the top face
+    // spans the column. The glow only depends on the distance of each
+    // component to the middle, so the axis order and sign do not matter.
+    vec2 local = (p.xz - center) * 0.5;
+    vec2 texcoord;
+    if (face == FACE_POINT)
+        texcoord = vec2(0.125, 0.5);
+    else if (face == FACE_POS_Y || face == FACE_NEG_Y)
+        texcoord = local + 0.5;
+    else
+        texcoord = vec2(instance.a > 0.0 ? p.y / instance.a : 0.0, (face >> 1 == 0u ? local.y : local.x) + 0.5);
+
+    vec2 multiplier = pow( abs( fract( texcoord ) - 0.5 ), vec2( attenuation ) );
+
+    vec3 colorShaded = instance.rgb * brightness * length( multiplier );
+    float camToPointDist = distance(p, camPos);
+    vec3 rayDir = normalize(p - camPos);
+
+    float specularColor = 0.5f;
+    vec3 cameraSpaceNormal = normalize(vec3(MV * vec4(normal, 0.0)));
+
+    FragColor = vec4(applyFog(colorShaded, camToPointDist, camPos, rayDir) , specularColor);
+    Normal = encodeNormal(cameraSpaceNormal, 15.f);
+}
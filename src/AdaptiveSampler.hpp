@@ -0,0 +1,115 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <vector>
+#include <utility>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Samples any curve with an evaluate(double t) const member, such as
+// Spline or BezierEvaluator, by recursive subdivision. An interval is kept
+// once its midpoint and quarter points all lie within Tolerance of the
+// chord, so straight stretches end up with a few points and tight turns
+// with many. Each level reuses the points of the level above, which costs
+// two evaluations per subdivision.
+template <class Curve>
+class AdaptiveSampler
+{
+    public:
+        typedef decltype(declval<const Curve &>().evaluate(0.0)) Point;
+
+        AdaptiveSampler()
+            : Tolerance(0.01f), MaxDepth(12), MinSegments(1)
+        {
+        }
+
+        // largest distance allowed between the curve and its polyline
+        void setTolerance(float tolerance)
+        {
+            Tolerance = tolerance;
+        }
+
+        // bounds the work, an interval is never split more than depth times
+        void setMaxDepth(int depth)
+        {
+            MaxDepth = depth;
+        }
+
+        // uniform intervals tested before any subdivision, at least one per
+        // curve piece so a feature cannot hide between two test points
+        void setMinSegments(int segments)
+        {
+            MinSegments = segments < 1 ? 1 : segments;
+        }
+
+        // Appends the samples of [t0, t1] to points, both ends included, and
+        // their parameters to parameters when given. Returns the number of
+        // points appended.
+        int sample(const Curve & curve, double t0, double t1, vector<Point> & points, vector<double> * parameters = 0) const
+        {
+            size_t first = points.size();
+            Point start = curve.evaluate(t0);
+            push(points, parameters, start, t0);
+
+            for (int i = 0; i < MinSegments; ++i)
+            {
+                double a = t0 + (t1 - t0) * i / MinSegments;
+                double b = i == MinSegments - 1 ? t1 : t0 + (t1 - t0) * (i + 1) / MinSegments;
+                Point end = curve.evaluate(b);
+                subdivide(curve, a, b, start, curve.evaluate(0.5 * (a + b)), end, 0, points, parameters);
+                start = end;
+            }
+
+            return int(points.size() - first);
+        }
+
+        int sample(const Curve & curve, vector<Point> & points, vector<double> * parameters = 0) const
+        {
+            return sample(curve, 0.0, 1.0, points, parameters);
+        }
+
+    private:
+        static void push(vector<Point> & points, vector<double> * parameters, const Point & p, double t)
+        {
+            points.push_back(p);
+            if (parameters)
+                parameters->push_back(t);
+        }
+
+        static float distanceToChord(const Point & p, const Point & a, const Point & b)
+        {
+            Point chord = b - a;
+            float length2 = dot(chord, chord);
+            float ratio = length2 > 0.f ? dot(p - a, chord) / length2 : 0.f;
+            ratio = ratio < 0.f ? 0.f : (ratio > 1.f ? 1.f : ratio);
+            return distance(p, a + ratio * chord);
+        }
+
+        // start is already in the output, end is appended last
+        void subdivide(const Curve & curve, double t0, double t1, const Point & start, const Point & middle, const Point & end,
+                       int depth, vector<Point> & points, vector<double> * parameters) const
+        {
+            double tm = 0.5 * (t0 + t1);
+            Point left = curve.evaluate(0.5 * (t0 + tm));
+            Point right = curve.evaluate(0.5 * (tm + t1));
+
+            if (depth >= MaxDepth || (distanceToChord(middle, start, end) <= Tolerance &&
+                                      distanceToChord(left, start, end) <= Tolerance &&
+                                      distanceToChord(right, start, end) <= Tolerance))
+            {
+                push(points, parameters, end, t1);
+                return;
+            }
+
+            subdivide(curve, t0, tm, start, left, middle, depth + 1, points, parameters);
+            subdivide(curve, tm, t1, middle, right, end, depth + 1, points, parameters);
+        }
+
+        float Tolerance;
+        int MaxDepth;
+        int MinSegments;
+};
+
+#endif
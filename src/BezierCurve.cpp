@@ -1,11 +1,21 @@
 #include "BezierCurve.hpp"
+#include "BezierEvaluator.hpp"
+#include "BezierKernel.hpp"
+#include "AdaptiveSampler.hpp"
 
 #include <iostream>
 
 #include <string>
 #include <cmath>
+#include <iterator>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BEZIER_USE_SSE 1
+#endif
 
 BezierCurve::BezierCurve()
+    : BasisDegree(-1), BasisSamples(0), BasisStride(0)
 {
     CreateFactorialTable();
 }
@@ -64,6 +74,57 @@ void BezierCurve::CreateFactorialTable()
         FactorialLookup[i] = a[i];
 }
 
+// fill the basis table for a curve of degree n sampled cpts times,
+// walking t exactly like Bezier3D so both paths see the same weights
+void BezierCurve::CreateBasisTable(int n, int cpts)
+{
+    if (n == BasisDegree && cpts == BasisSamples)
+        return;
+
+    BasisDegree = n;
+    BasisSamples = cpts;
+    BasisStride = (cpts + 3) & ~3;
+    BasisTable.assign((n + 1) * BasisStride, 0.f);
+
+    // binomial row once, then powers of t and 1 - t by running products
+    // instead of two pow() per weight. Past the degree where the row
+    // overflows, each sample runs the recurrence instead.
+    vector<double> ni(n + 1), ti(n + 1), tni(n + 1);
+    bool useRecurrence = BinomialRow(n, &ni[0]) != BEZIER_OK;
+
+    double t = 0;
+    double step = (double)1.0 / (cpts - 1);
+
+    for (int i1 = 0; i1 != cpts; i1++)
+    {
+        if ((1.0 - t) < 5e-6)
+            t = 1.0;
+
+        if (useRecurrence)
+        {
+            BernsteinRow(n, t, &ti[0]);
+            for (int jcount = 0; jcount <= n; ++jcount)
+                BasisTable[jcount * BasisStride + i1] = float(ti[jcount]);
+
+            t += step;
+            continue;
+        }
+
+        ti[0] = 1.0;
+        tni[0] = 1.0;
+        for (int jcount = 1; jcount <= n; ++jcount)
+        {
+            ti[jcount] = ti[jcount - 1] * t;
+            tni[jcount] = tni[jcount - 1] * (1 - t);
+        }
+
+        for (int jcount = 0; jcount <= n; ++jcount)
+            BasisTable[jcount * BasisStride + i1] = float(ni[jcount] * ti[jcount] * tni[n - jcount]);
+
+        t += step;
+    }
+}
+
 double BezierCurve::Ni(int n, int i)
 {
     double ni;
@@ -98,6 +159,56 @@ double BezierCurve::Bernstein(int n, int i, double t)
     return basis;
 }
 
+BezierStatus BezierCurve::BernsteinStable(int n, int i, double t, double & value)
+{
+    if (n < 0)
+        return BEZIER_INVALID_DEGREE;
+    if (i < 0 || i > n)
+        return BEZIER_INVALID_INDEX;
+
+    value = BernsteinProduct(n, i, t);
+    return BEZIER_OK;
+}
+
+BezierStatus BezierCurve::BernsteinRow(int n, double t, double * basis)
+{
+    if (n < 0)
+        return BEZIER_INVALID_DEGREE;
+
+    // degree k from degree k - 1, right to left so it works in place
+    double u = 1.0 - t;
+    basis[0] = 1.0;
+    for (int k = 1; k <= n; ++k)
+    {
+        basis[k] = t * basis[k - 1];
+        for (int j = k - 1; j > 0; --j)
+            basis[j] = u * basis[j] + t * basis[j - 1];
+        basis[0] *= u;
+    }
+
+    return BEZIER_OK;
+}
+
+BezierStatus BezierCurve::BinomialRow(int n, double * row)
+{
+    if (n < 0)
+        return BEZIER_INVALID_DEGREE;
+
+    row[0] = 1.0;
+    for (int k = 1; k <= n; ++k)
+    {
+        row[k] = 1.0;
+        for (int j = k - 1; j > 0; --j)
+            row[j] += row[j - 1];
+    }
+
+    // C(n, n / 2) is the largest coefficient
+    if (std::isinf(row[n / 2]))
+        return BEZIER_OVERFLOW;
+
+    return BEZIER_OK;
+}
+
 /*
 void BezierCurve::Bezier2D(double b[], int cpts, double p[])
 {
@@ -133,61 +244,76 @@ void BezierCurve::Bezier2D(double b[], int cpts, double p[])
 }
  */
 
-vector<vec2> BezierCurve::Bezier2D(vector<vec2> b, int cpts)
+vector<vec2> BezierCurve::Bezier2D(const vector<vec2> & b, int cpts)
 {
-    int icount;
-    double step, t;
     vector<vec2> p(cpts);
+    if (!b.empty())
+        EvaluateBezierRange<2, float>(&b[0], int(b.size()), 0.0, 1.0, cpts, p.begin());
+    return p;
+}
 
-    // Calculate points on curve
-
-    icount = 0;
-    t = 0;
-    step = (double)1.0 / (cpts - 1);
-
-    for (int i1 = 0; i1 != cpts; i1++)
-    {
-        if ((1.0 - t) < 5e-6)
-            t = 1.0;
-        p[icount] = vec2(0.0, 0.0);
-        for (unsigned int jcount = 0; jcount != b.size(); ++jcount)
-        {
-            float basis = Bernstein(b.size() - 1, jcount, t);
-            p[icount] += basis * b[jcount];
-        }
-
-        ++ icount;
-        t += step;
-    }
+vector<vec3> BezierCurve::Bezier3D(const vector<vec3> & b, int cpts)
+{
+    vector<vec3> p(cpts);
+    if (!b.empty())
+        EvaluateBezierRange<3, float>(&b[0], int(b.size()), 0.0, 1.0, cpts, p.begin());
+    return p;
+}
 
+vector<vec3> BezierCurve::Bezier3DAdaptive(const vector<vec3> & b, float tolerance, vector<double> * parameters)
+{
+    vector<vec3> p;
+    if (b.empty())
+        return p;
+
+    // one starting interval per degree, a high degree curve can turn that
+    // many times between two tests
+    AdaptiveSampler< BezierEvaluator<vec3> > sampler;
+    sampler.setTolerance(tolerance);
+    sampler.setMinSegments(int(b.size()) - 1);
+    sampler.sample(BezierEvaluator<vec3>(b), p, parameters);
     return p;
 }
 
-vector<vec3> BezierCurve::Bezier3D(vector<vec3> b, int cpts)
+vector<vec3> BezierCurve::Bezier3DTable(const vector<vec3> & b, int cpts)
 {
-    int icount;
-    double step, t;
     vector<vec3> p(cpts);
+    if (b.empty() || cpts < 2)
+        return p;
 
-    // Calculate points on curve
+    int n = int(b.size()) - 1;
+    CreateBasisTable(n, cpts);
 
-    icount = 0;
-    t = 0;
-    step = (double)1.0 / (cpts - 1);
-
-    for (int i1 = 0; i1 != cpts; i1++)
+    // Each row of the table holds one control point's weight for every
+    // sample, so a sample block is a run of multiply-adds across the rows
+    int i1 = 0;
+#ifdef BEZIER_USE_SSE
+    for (; i1 + 4 <= cpts; i1 += 4)
     {
-        if ((1.0 - t) < 5e-6)
-            t = 1.0;
-        p[icount] = vec3(0.0, 0.0, 0.0);
-        for (unsigned int jcount = 0; jcount != b.size(); ++jcount)
+        __m128 px = _mm_setzero_ps();
+        __m128 py = _mm_setzero_ps();
+        __m128 pz = _mm_setzero_ps();
+        for (int jcount = 0; jcount <= n; ++jcount)
         {
-            float basis = Bernstein(b.size() - 1, jcount, t);
-            p[icount] += basis * b[jcount];
+            __m128 basis = _mm_loadu_ps(&BasisTable[jcount * BasisStride + i1]);
+            px = _mm_add_ps(px, _mm_mul_ps(basis, _mm_set1_ps(b[jcount].x)));
+            py = _mm_add_ps(py, _mm_mul_ps(basis, _mm_set1_ps(b[jcount].y)));
+            pz = _mm_add_ps(pz, _mm_mul_ps(basis, _mm_set1_ps(b[jcount].z)));
         }
 
-        ++ icount;
-        t += step;
+        float x[4], y[4], z[4];
+        _mm_storeu_ps(x, px);
+        _mm_storeu_ps(y, py);
+        _mm_storeu_ps(z, pz);
+        for (int k = 0; k < 4; ++k)
+            p[i1 + k] = vec3(x[k], y[k], z[k]);
+    }
+#endif
+    for (; i1 < cpts; ++i1)
+    {
+        p[i1] = vec3(0.0, 0.0, 0.0);
+        for (int jcount = 0; jcount <= n; ++jcount)
+            p[i1] += BasisTable[jcount * BasisStride + i1] * b[jcount];
     }
 
     return p;
@@ -198,21 +324,13 @@ int BezierCurve::getFactorialMax()
     return g_FactorialMax;
 }
 
-vector<vec3> BezierCurve::InterpolateBetweenPoints(vector<vec3> b, int nbPointsBetween)
+vector<vec3> BezierCurve::InterpolateBetweenPoints(const vector<vec3> & b, int nbPointsBetween)
 {
     vector<vec3> p;
-    p.push_back(b[0]);
-
-    for(unsigned int i = 1; i < b.size(); ++i)
-    {
-        for(int j = 1; j < nbPointsBetween; ++j)
-        {
-            double ratio = double(j) / nbPointsBetween;
-            double ratioNext = 1.0 - ratio;
-
-            p.push_back(float(ratio) * b[i] + float(ratioNext) * b[i - 1]);
-        }
-    }
+    if (b.empty())
+        return p;
 
+    p.reserve(1 + (b.size() - 1) * (nbPointsBetween > 1 ? nbPointsBetween - 1 : 0));
+    ::InterpolateBetweenPoints(&b[0], int(b.size()), nbPointsBetween, back_inserter(p));
     return p;
 }
\ No newline at end of file
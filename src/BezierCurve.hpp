@@ -7,24 +7,63 @@
 using namespace std;
 using namespace glm;
 
+// Return codes of the exception free evaluation path
+enum BezierStatus
+{
+    BEZIER_OK = 0,
+    BEZIER_INVALID_DEGREE, // negative degree
+    BEZIER_INVALID_INDEX,  // basis index outside [0, degree]
+    BEZIER_OVERFLOW        // binomial coefficients no longer fit a double
+};
+
 class BezierCurve
 {
     static const int g_FactorialMax = 33;
     double FactorialLookup[g_FactorialMax];
 
+    // Bernstein basis cached for the last (degree, sample count) pair,
+    // one row per control point, padded to a multiple of 4 samples
+    int BasisDegree;
+    int BasisSamples;
+    int BasisStride;
+    vector<float> BasisTable;
+
     public:
         BezierCurve();
         // void Bezier2D(double b[], int cpts, double p[]);
-        vector<vec2> Bezier2D(vector<vec2> b, int cpts);
-        vector<vec3> Bezier3D(vector<vec3> b, int cpts);
+        // Wrappers over EvaluateBezierRange: the unrolled BezierKernel up to
+        // degree 7, BezierEvaluator above, which also evaluates in place for
+        // callers that do not need the whole curve materialized
+        vector<vec2> Bezier2D(const vector<vec2> & b, int cpts);
+        vector<vec3> Bezier3D(const vector<vec3> & b, int cpts);
+        // Same samples as Bezier3D, evaluated from the cached basis table.
+        // Powers are built by running products instead of pow(), so points
+        // match Bezier3D within 1e-5 of the control polygon extent.
+        vector<vec3> Bezier3DTable(const vector<vec3> & b, int cpts);
+        // Recursive subdivision instead of a fixed step, see AdaptiveSampler
+        vector<vec3> Bezier3DAdaptive(const vector<vec3> & b, float tolerance, vector<double> * parameters = 0);
         int getFactorialMax();
-        vector<vec3> InterpolateBetweenPoints(vector<vec3> b, int nbPointsBetween);
+        vector<vec3> InterpolateBetweenPoints(const vector<vec3> & b, int nbPointsBetween);
+        // Basis function i of degree n at t, pow() and factorial based
+        double Bernstein(int n, int i, double t);
+
+        // Any degree, no exceptions, nothing allocated. value is only
+        // written on BEZIER_OK.
+        // Basis i of degree n, see BernsteinProduct
+        static BezierStatus BernsteinStable(int n, int i, double t, double & value);
+        // All n + 1 basis values at t into basis, by the de Casteljau
+        // recurrence: O(n^2), only convex combinations, so it cannot
+        // overflow and every value is within n * eps of the exact one
+        static BezierStatus BernsteinRow(int n, double t, double * basis);
+        // C(n, 0..n) into row by Pascal's rule, exact up to n = 56 and
+        // BEZIER_OVERFLOW past n = 1029
+        static BezierStatus BinomialRow(int n, double * row);
 
     private:
         double factorial(int n);
         void CreateFactorialTable();
+        void CreateBasisTable(int n, int cpts);
         double Ni(int n, int i);
-        double Bernstein(int n, int i, double t);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,208 @@
+#ifndef BEZIER_EVALUATOR_H
+#define BEZIER_EVALUATOR_H
+
+#include <vector>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Double precision accumulator for each point type
+template <class T> struct BezierAccumulator { typedef T type; };
+template <> struct BezierAccumulator<float> { typedef double type; };
+template <> struct BezierAccumulator<vec2> { typedef dvec2 type; };
+template <> struct BezierAccumulator<vec3> { typedef dvec3 type; };
+template <> struct BezierAccumulator<vec4> { typedef dvec4 type; };
+
+// Past this degree evaluate() switches to evaluateWide(). The Horner sum
+// grows up to 2^n times the largest coordinate; at n = 256 that stays
+// within a double for any float input, at n = 1000 it overflows from 1e9.
+#define BEZIER_HORNER_MAX_DEGREE 256
+
+// Bernstein basis i of degree n at t as a product of n factors, i of them
+// t (n - i + k) / k and n - i of them 1 - t, taking a 1 - t whenever the
+// product has grown past 1 so it never overflows on the way to a value
+// in [0, 1]. Relative error grows as n * eps. Expects 0 <= i <= n.
+inline double BernsteinProduct(int n, int i, double t)
+{
+    double u = 1.0 - t;
+    double result = 1.0;
+    int k = 1;
+    int m = n - i;
+    while (k <= i || m > 0)
+    {
+        if (k <= i && (m == 0 || result < 1.0))
+        {
+            result *= t * (n - i + k) / k;
+            ++k;
+        }
+        else
+        {
+            result *= u;
+            --m;
+        }
+    }
+
+    return result;
+}
+
+// Bezier curve over control points owned by the caller. Binding keeps a
+// pointer only, evaluate() runs the Horner form of the Bernstein sum in
+// O(degree) without pow() or factorials, and evaluateRange() writes into
+// caller storage, so nothing here touches the heap.
+template <class T>
+class BezierEvaluator
+{
+    public:
+        BezierEvaluator()
+            : ControlPoints(0), Count(0)
+        {
+        }
+
+        BezierEvaluator(const T * controlPoints, int count)
+            : ControlPoints(controlPoints), Count(count)
+        {
+        }
+
+        explicit BezierEvaluator(const vector<T> & controlPoints)
+            : ControlPoints(controlPoints.empty() ? 0 : &controlPoints[0]), Count(int(controlPoints.size()))
+        {
+        }
+
+        void bind(const T * controlPoints, int count)
+        {
+            ControlPoints = controlPoints;
+            Count = count;
+        }
+
+        int getDegree() const
+        {
+            return Count - 1;
+        }
+
+        T evaluate(double t) const
+        {
+            typedef typename BezierAccumulator<T>::type Accumulator;
+
+            if (Count <= 0)
+                return T(0);
+
+            int n = Count - 1;
+            if (n > BEZIER_HORNER_MAX_DEGREE)
+                return evaluateWide(t);
+
+            double u = 1.0 - t;
+            Accumulator acc(ControlPoints[0]);
+            double binomial = 1.0;
+            double scale = 1.0;
+
+            // Factor out the larger of t^n and (1 - t)^n so the Horner
+            // variable stays in [0, 1]
+            if (t < 0.5)
+            {
+                double s = t / u;
+                acc = Accumulator(ControlPoints[n]);
+                for (int i = n - 1; i >= 0; --i)
+                {
+                    binomial = binomial * (i + 1) / (n - i);
+                    acc = acc * s + binomial * Accumulator(ControlPoints[i]);
+                    scale *= u;
+                }
+            }
+            else
+            {
+                double s = u / t;
+                for (int i = 1; i <= n; ++i)
+                {
+                    binomial = binomial * (n - i + 1) / i;
+                    acc = acc * s + binomial * Accumulator(ControlPoints[i]);
+                    scale *= t;
+                }
+            }
+
+            return T(acc * scale);
+        }
+
+        // count samples evenly spaced from t0 to t1, both included
+        template <class OutputIterator>
+        OutputIterator evaluateRange(double t0, double t1, int count, OutputIterator out) const
+        {
+            if (count == 1)
+            {
+                *out++ = evaluate(t0);
+                return out;
+            }
+
+            for (int i = 0; i < count; ++i)
+                *out++ = evaluate(i == count - 1 ? t1 : t0 + (t1 - t0) * i / (count - 1));
+
+            return out;
+        }
+
+    private:
+        // Starts from the largest weight, at i = n t, and walks outwards
+        // with the ratio of neighbouring weights, stopping once they no
+        // longer register. No binomial is ever formed, so any degree works,
+        // and only about sqrt(n) terms around the peak are visited. The
+        // ratios need 0 < t < 1, so t is clamped to the curve.
+        T evaluateWide(double t) const
+        {
+            typedef typename BezierAccumulator<T>::type Accumulator;
+
+            int n = Count - 1;
+            if (t <= 0.0)
+                return ControlPoints[0];
+            if (t >= 1.0)
+                return ControlPoints[n];
+
+            double u = 1.0 - t;
+            int peak = int(t * n + 0.5);
+            double peakWeight = BernsteinProduct(n, peak, t);
+            double cutoff = peakWeight * 1e-17;
+            Accumulator acc = peakWeight * Accumulator(ControlPoints[peak]);
+
+            double weight = peakWeight;
+            for (int i = peak + 1; i <= n && weight > cutoff; ++i)
+            {
+                weight *= t / u * (n - i + 1) / i;
+                acc += weight * Accumulator(ControlPoints[i]);
+            }
+
+            weight = peakWeight;
+            for (int i = peak - 1; i >= 0 && weight > cutoff; --i)
+            {
+                weight *= u / t * (i + 1) / (n - i);
+                acc += weight * Accumulator(ControlPoints[i]);
+            }
+
+            return T(acc);
+        }
+
+        const T * ControlPoints;
+        int Count;
+};
+
+// Points strictly between each pair of consecutive control points, after
+// the first control point, nbPointsBetween - 1 per pair
+template <class T, class OutputIterator>
+OutputIterator InterpolateBetweenPoints(const T * b, int count, int nbPointsBetween, OutputIterator out)
+{
+    if (count <= 0)
+        return out;
+
+    *out++ = b[0];
+    for (int i = 1; i < count; ++i)
+    {
+        for (int j = 1; j < nbPointsBetween; ++j)
+        {
+            double ratio = double(j) / nbPointsBetween;
+            double ratioNext = 1.0 - ratio;
+
+            *out++ = float(ratio) * b[i] + float(ratioNext) * b[i - 1];
+        }
+    }
+
+    return out;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef BEZIER_KERNEL_H
+#define BEZIER_KERNEL_H
+
+#include <glm.hpp>
+
+#include "BezierEvaluator.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Degrees up to this one get an unrolled kernel in EvaluateBezier
+#define BEZIER_KERNEL_MAX_DEGREE 7
+
+// C(n, k), exact in integers and usable as a compile time constant
+constexpr unsigned long long BezierBinomial(int n, int k)
+{
+    return (k < 0 || k > n) ? 0 : (k == 0 ? 1 : BezierBinomial(n, k - 1) * (n - k + 1) / k);
+}
+
+// Point type for a dimension and a scalar type
+template <int Dim, class T> struct BezierVector;
+template <class T> struct BezierVector<1, T> { typedef T type; };
+template <class T> struct BezierVector<2, T> { typedef tvec2<T, highp> type; };
+template <class T> struct BezierVector<3, T> { typedef tvec3<T, highp> type; };
+template <class T> struct BezierVector<4, T> { typedef tvec4<T, highp> type; };
+
+// x^0 .. x^N, one multiply per entry
+template <int N>
+struct BezierPowers
+{
+    template <class T>
+    static void fill(T x, T * out)
+    {
+        BezierPowers<N - 1>::fill(x, out);
+        out[N] = out[N - 1] * x;
+    }
+};
+
+template <>
+struct BezierPowers<0>
+{
+    template <class T>
+    static void fill(T, T * out)
+    {
+        out[0] = T(1);
+    }
+};
+
+// Bernstein terms I .. Degree, with the binomials folded in as constants
+template <int Degree, int I>
+struct BezierTerms
+{
+    template <class V, class T>
+    static V sum(const V * p, const T * tp, const T * up)
+    {
+        return p[I] * (T(BezierBinomial(Degree, I)) * tp[I] * up[Degree - I])
+             + BezierTerms<Degree, I + 1>::sum(p, tp, up);
+    }
+};
+
+template <int Degree>
+struct BezierTerms<Degree, Degree>
+{
+    template <class V, class T>
+    static V sum(const V * p, const T * tp, const T *)
+    {
+        return p[Degree] * tp[Degree];
+    }
+};
+
+// Bezier curve of a fixed degree over Degree + 1 points of dimension Dim.
+// Everything is resolved at compile time: no loop, no branch, no pow().
+template <int Dim, int Degree, class T = float>
+struct BezierKernel
+{
+    typedef typename BezierVector<Dim, T>::type vector_type;
+
+    static vector_type evaluate(const vector_type * p, T t)
+    {
+        T tp[Degree + 1];
+        T up[Degree + 1];
+        BezierPowers<Degree>::fill(t, tp);
+        BezierPowers<Degree>::fill(T(1) - t, up);
+        return BezierTerms<Degree, 0>::sum(p, tp, up);
+    }
+};
+
+template <int Dim, class T>
+struct BezierKernel<Dim, 0, T>
+{
+    typedef typename BezierVector<Dim, T>::type vector_type;
+
+    static vector_type evaluate(const vector_type * p, T)
+    {
+        return p[0];
+    }
+};
+
+// Picks the unrolled kernel for the low degrees, the runtime evaluator
+// above BEZIER_KERNEL_MAX_DEGREE
+template <int Dim, class T>
+typename BezierVector<Dim, T>::type EvaluateBezier(const typename BezierVector<Dim, T>::type * p, int count, T t)
+{
+    switch (count - 1)
+    {
+        case 0: return BezierKernel<Dim, 0, T>::evaluate(p, t);
+        case 1: return BezierKernel<Dim, 1, T>::evaluate(p, t);
+        case 2: return BezierKernel<Dim, 2, T>::evaluate(p, t);
+        case 3: return BezierKernel<Dim, 3, T>::evaluate(p, t);
+        case 4: return BezierKernel<Dim, 4, T>::evaluate(p, t);
+        case 5: return BezierKernel<Dim, 5, T>::evaluate(p, t);
+        case 6: return BezierKernel<Dim, 6, T>::evaluate(p, t);
+        case 7: return BezierKernel<Dim, 7, T>::evaluate(p, t);
+        default:
+            return BezierEvaluator<typename BezierVector<Dim, T>::type>(p, count).evaluate(t);
+    }
+}
+
+// samples points evenly spaced from t0 to t1, both included, at the same
+// parameters as BezierEvaluator::evaluateRange()
+template <int Dim, int Degree, class T, class OutputIterator>
+OutputIterator BezierKernelRange(const typename BezierVector<Dim, T>::type * p, double t0, double t1, int samples, OutputIterator out)
+{
+    if (samples == 1)
+    {
+        *out++ = BezierKernel<Dim, Degree, T>::evaluate(p, T(t0));
+        return out;
+    }
+
+    for (int i = 0; i < samples; ++i)
+        *out++ = BezierKernel<Dim, Degree, T>::evaluate(p, T(i == samples - 1 ? t1 : t0 + (t1 - t0) * i / (samples - 1)));
+
+    return out;
+}
+
+// EvaluateBezier() over a range, the degree is only switched on once
+template <int Dim, class T, class OutputIterator>
+OutputIterator EvaluateBezierRange(const typename BezierVector<Dim, T>::type * p, int count, double t0, double t1, int samples, OutputIterator out)
+{
+    switch (count - 1)
+    {
+        case 0: return BezierKernelRange<Dim, 0, T>(p, t0, t1, samples, out);
+        case 1: return BezierKernelRange<Dim, 1, T>(p, t0, t1, samples, out);
+        case 2: return BezierKernelRange<Dim, 2, T>(p, t0, t1, samples, out);
+        case 3: return BezierKernelRange<Dim, 3, T>(p, t0, t1, samples, out);
+        case 4: return BezierKernelRange<Dim, 4, T>(p, t0, t1, samples, out);
+        case 5: return BezierKernelRange<Dim, 5, T>(p, t0, t1, samples, out);
+        case 6: return BezierKernelRange<Dim, 6, T>(p, t0, t1, samples, out);
+        case 7: return BezierKernelRange<Dim, 7, T>(p, t0, t1, samples, out);
+        default:
+            return BezierEvaluator<typename BezierVector<Dim, T>::type>(p, count).evaluateRange(t0, t1, samples, out);
+    }
+}
+
+#endif
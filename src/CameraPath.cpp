@@ -0,0 +1,215 @@
+#include "CameraPath.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+CameraPath::CameraPath()
+    : Length(0.f), Step(0.f), Duration(1.f), Leveling(0.f), Closed(false)
+{
+}
+
+void CameraPath::setLeveling(float distance)
+{
+    Leveling = distance;
+}
+
+void CameraPath::build(const vector<vec3> & points, int resolution, bool closed, vec3 up)
+{
+    Closed = closed;
+    Table.clear();
+    Frames.clear();
+    Length = 0.f;
+    Step = 0.f;
+
+    if (points.empty())
+        return;
+    if (points.size() == 1 || resolution < 1)
+    {
+        Table.push_back(points[0]);
+        buildFrames(up);
+        return;
+    }
+
+    // cumulative arc length at each input point
+    vector<float> cumulative(points.size());
+    cumulative[0] = 0.f;
+    for (unsigned int i = 1; i < points.size(); ++i)
+        cumulative[i] = cumulative[i - 1] + distance(points[i - 1], points[i]);
+
+    Length = cumulative.back();
+    Step = Length / resolution;
+    Table.resize(resolution + 1);
+
+    // both sequences are increasing, so one forward walk resamples them
+    unsigned int segment = 1;
+    for (int k = 0; k <= resolution; ++k)
+    {
+        float s = k * Step;
+        while (segment < points.size() - 1 && cumulative[segment] < s)
+            ++segment;
+
+        float segmentLength = cumulative[segment] - cumulative[segment - 1];
+        float ratio = segmentLength > 0.f ? (s - cumulative[segment - 1]) / segmentLength : 0.f;
+        ratio = ratio < 0.f ? 0.f : (ratio > 1.f ? 1.f : ratio);
+        Table[k] = mix(points[segment - 1], points[segment], ratio);
+    }
+    Table[resolution] = points.back();
+
+    buildFrames(up);
+}
+
+// Rotation-minimizing frames by double reflection (Wang et al. 2008). With
+// leveling, each step also turns the normal part of the way back to the
+// projected up vector, so turns bank then settle instead of accumulating
+// roll. On a closed path the twist left at the end is spread back along
+// the loop so the last frame meets the first one.
+void CameraPath::buildFrames(vec3 up)
+{
+    int n = int(Table.size());
+    Frames.resize(n);
+
+    vector<vec3> tangents(n);
+    for (int k = 0; k < n; ++k)
+    {
+        int previous = k > 0 ? k - 1 : (Closed && n > 2 ? n - 2 : 0);
+        int next = k < n - 1 ? k + 1 : (Closed && n > 2 ? 1 : n - 1);
+        vec3 tangent = Table[next] - Table[previous];
+        if (dot(tangent, tangent) > 1e-12f)
+            tangents[k] = normalize(tangent);
+        else
+            tangents[k] = k > 0 ? tangents[k - 1] : vec3(0.f, 0.f, -1.f);
+    }
+
+    vector<vec3> normals(n);
+    vec3 normal = up - dot(up, tangents[0]) * tangents[0];
+    if (dot(normal, normal) < 1e-12f)
+        normal = cross(tangents[0], vec3(1.f, 0.f, 0.f));
+    normals[0] = normalize(normal);
+
+    // A leveled loop converges to the same frames whatever it starts
+    // from, so a second lap starting where the first one ended leaves
+    // almost no twist at the seam
+    int laps = (Closed && Leveling > 0.f) ? 2 : 1;
+    for (int lap = 0; lap < laps; ++lap)
+    {
+        if (lap > 0)
+            normals[0] = normalize(normals[n - 1] - dot(normals[n - 1], tangents[0]) * tangents[0]);
+
+        for (int k = 0; k + 1 < n; ++k)
+        {
+            vec3 v1 = Table[k + 1] - Table[k];
+            float c1 = dot(v1, v1);
+            if (c1 < 1e-12f)
+            {
+                normals[k + 1] = normals[k];
+                continue;
+            }
+            vec3 rL = normals[k] - (2.f / c1) * dot(v1, normals[k]) * v1;
+            vec3 tL = tangents[k] - (2.f / c1) * dot(v1, tangents[k]) * v1;
+            vec3 v2 = tangents[k + 1] - tL;
+            float c2 = dot(v2, v2);
+            normals[k + 1] = c2 < 1e-12f ? rL : rL - (2.f / c2) * dot(v2, rL) * v2;
+
+            vec3 level = up - dot(up, tangents[k + 1]) * tangents[k + 1];
+            if (Leveling > 0.f && dot(level, level) > 1e-12f)
+            {
+                level = normalize(level);
+                float roll = atan2(dot(cross(normals[k + 1], level), tangents[k + 1]), dot(normals[k + 1], level));
+                float amount = sqrt(c1) / Leveling;
+                normals[k + 1] = angleAxis(roll * (amount < 1.f ? amount : 1.f), tangents[k + 1]) * normals[k + 1];
+            }
+        }
+    }
+
+    float twist = 0.f;
+    if (Closed && n > 2)
+    {
+        vec3 last = normals[n - 1];
+        twist = atan2(dot(cross(last, normals[0]), tangents[0]), dot(last, normals[0]));
+    }
+
+    for (int k = 0; k < n; ++k)
+    {
+        vec3 forward = tangents[k];
+        vec3 frameUp = normals[k];
+        if (twist != 0.f)
+            frameUp = angleAxis(twist * k / (n - 1), forward) * frameUp;
+        frameUp = normalize(frameUp - dot(frameUp, forward) * forward);
+        vec3 side = cross(forward, frameUp);
+        Frames[k] = quat_cast(mat3(side, frameUp, -forward));
+    }
+}
+
+float CameraPath::getLength() const
+{
+    return Length;
+}
+
+int CameraPath::size() const
+{
+    return int(Table.size());
+}
+
+void CameraPath::setDuration(float seconds)
+{
+    // a zero duration would divide time by 0
+    Duration = std::max(seconds, 1e-3f);
+}
+
+void CameraPath::locate(float s, int & i, float & u) const
+{
+    if (Closed)
+    {
+        s = fmod(s, Length);
+        if (s < 0.f)
+            s += Length;
+    }
+    else
+        s = s < 0.f ? 0.f : (s > Length ? Length : s);
+
+    float position = s / Step;
+    i = int(position);
+    if (i > int(Table.size()) - 2)
+        i = int(Table.size()) - 2;
+    u = position - i;
+}
+
+float CameraPath::distanceAtTime(float t) const
+{
+    // wrap time first so long runs keep their precision
+    if (Closed)
+        t = fmod(t, Duration);
+    return t / Duration * Length;
+}
+
+vec3 CameraPath::positionAtDistance(float s) const
+{
+    if (Table.size() < 2 || Length <= 0.f)
+        return Table.empty() ? vec3(0.f) : Table[0];
+
+    int i;
+    float u;
+    locate(s, i, u);
+    return mix(Table[i], Table[i + 1], u);
+}
+
+vec3 CameraPath::positionAtTime(float t) const
+{
+    return positionAtDistance(distanceAtTime(t));
+}
+
+quat CameraPath::orientationAtDistance(float s) const
+{
+    if (Frames.size() < 2 || Length <= 0.f)
+        return Frames.empty() ? quat() : Frames[0];
+
+    int i;
+    float u;
+    locate(s, i, u);
+    return slerp(Frames[i], Frames[i + 1], u);
+}
+
+quat CameraPath::orientationAtTime(float t) const
+{
+    return orientationAtDistance(distanceAtTime(t));
+}
@@ -0,0 +1,57 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <vector>
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Path resampled at uniform arc length, so a lookup by distance or time
+// is an index computation plus a blend of two table entries and the
+// camera moves at constant speed whatever the input spacing was.
+// Each entry also carries a rotation-minimizing frame, so orientation is a
+// slerp between two precomputed quaternions.
+class CameraPath
+{
+    public:
+        CameraPath();
+
+        // Distance over which the frames ease their roll back towards up
+        // after a turn. 0 keeps pure rotation-minimizing frames, which can
+        // drift far from level on long 3D tours. Call before build().
+        void setLeveling(float distance);
+
+        // points is a polyline along the curve; closed paths expect the
+        // last point to repeat the first one. Frames start with their up
+        // vector as close to up as the first tangent allows.
+        void build(const vector<vec3> & points, int resolution, bool closed, vec3 up = vec3(0.f, 1.f, 0.f));
+
+        float getLength() const;
+        int size() const;
+        // time needed to travel the whole path once, at least 1 ms
+        void setDuration(float seconds);
+
+        vec3 positionAtDistance(float s) const;
+        vec3 positionAtTime(float t) const;
+        // camera orientation: looks down -Z along the path, +Y is up
+        quat orientationAtDistance(float s) const;
+        quat orientationAtTime(float t) const;
+
+    private:
+        void buildFrames(vec3 up);
+        // table entry before s and the blend factor towards the next one
+        void locate(float s, int & i, float & u) const;
+        float distanceAtTime(float t) const;
+
+        vector<vec3> Table;
+        vector<quat> Frames;
+        float Length;
+        float Step;
+        float Duration;
+        float Leveling;
+        bool Closed;
+};
+
+#endif
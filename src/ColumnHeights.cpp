@@ -0,0 +1,71 @@
+#include "ColumnHeights.hpp"
+
+static vec3 mod289(const vec3 & x)
+{
+    return x - floor(x * (1.f / 289.f)) * 289.f;
+}
+
+static vec2 mod289(const vec2 & x)
+{
+    return x - floor(x * (1.f / 289.f)) * 289.f;
+}
+
+static vec3 permute(const vec3 & x)
+{
+    return mod289(((x * 34.f) + 1.f) * x);
+}
+
+float ColumnHeights::snoise(const vec2 & v)
+{
+    const vec4 C = vec4(0.211324865405187f,
+                        0.366025403784439f,
+                        -0.577350269189626f,
+                        0.024390243902439f);
+    // First corner
+    vec2 i = floor(v + dot(v, vec2(C.y)));
+    vec2 x0 = v - i + dot(i, vec2(C.x));
+
+    // Other corners
+    vec2 i1 = (x0.x > x0.y) ? vec2(1.f, 0.f) : vec2(0.f, 1.f);
+    vec4 x12 = vec4(x0.x, x0.y, x0.x, x0.y) + vec4(C.x, C.x, C.z, C.z);
+    x12.x -= i1.x;
+    x12.y -= i1.y;
+
+    // Permutations
+    i = mod289(i);
+    vec3 p = permute(permute(i.y + vec3(0.f, i1.y, 1.f)) + i.x + vec3(0.f, i1.x, 1.f));
+
+    vec3 m = max(0.5f - vec3(dot(x0, x0), dot(vec2(x12.x, x12.y), vec2(x12.x, x12.y)), dot(vec2(x12.z, x12.w), vec2(x12.z, x12.w))), 0.f);
+    m = m * m;
+    m = m * m;
+
+    // Gradients: 41 points uniformly over a line, mapped onto a diamond
+    vec3 x = 2.f * fract(p * C.w) - 1.f;
+    vec3 h = abs(x) - 0.5f;
+    vec3 ox = floor(x + 0.5f);
+    vec3 a0 = x - ox;
+
+    // Normalise gradients implicitly by scaling m
+    m *= 1.79284291400159f - 0.85373472095314f * (a0 * a0 + h * h);
+
+    // Compute final noise value at P
+    vec3 g;
+    g.x = a0.x * x0.x + h.x * x0.y;
+    g.y = a0.y * x12.x + h.y * x12.y;
+    g.z = a0.z * x12.z + h.z * x12.w;
+    return 130.f * dot(m, g);
+}
+
+float ColumnHeights::height(int column, int gridSize, float time, const vec3 & camPos)
+{
+    float translateX = float(column % gridSize - gridSize / 2);
+    float translateZ = float(column / gridSize - gridSize / 2);
+
+    float noise = snoise(vec2((column % gridSize) - (gridSize / 2) * time * 0.001f, translateZ));
+    if (noise < 0.f)
+        noise = -noise;
+
+    if (distance(vec3(translateX * 2.f, 10.f * noise, translateZ * 2.f), camPos) > 15.f)
+        return 10.f * noise;
+    return 1.f;
+}
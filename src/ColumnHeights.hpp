@@ -0,0 +1,22 @@
+#ifndef COLUMN_HEIGHTS_H
+#define COLUMN_HEIGHTS_H
+
+#include <glm.hpp>
+
+using namespace glm;
+
+// CPU copy of the column heights of cube_columns.vert, so the grid can be
+// reasoned about without reading the column pass back from the GPU.
+// Both sides are float, results match to rounding.
+class ColumnHeights
+{
+    public:
+        // 2D simplex noise, Ian McEwan / Ashima Arts, as in the shader
+        static float snoise(const vec2 & v);
+
+        // Height scale of the unit cube of column z * gridSize + x at time,
+        // the unit height within 15 units of camPos
+        static float height(int column, int gridSize, float time, const vec3 & camPos);
+};
+
+#endif
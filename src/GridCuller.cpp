@@ -0,0 +1,245 @@
+#include "GridCuller.hpp"
+#include "ColumnHeights.hpp"
+#include "OcclusionRasterizer.hpp"
+
+#include <algorithm>
+
+GridCuller::GridCuller()
+    : GridSize(0), Spacing(2.f), VisibleTiles(0), OccludedTiles(0), VisibleInstances(0), LodHysteresis(0.1f)
+{
+    for (int l = 0; l < LOD_COUNT; ++l)
+        VisibleLodInstances[l] = 0;
+    LodDistances[0] = 150.f;
+    LodDistances[1] = 400.f;
+}
+
+void GridCuller::build(int gridSize, int tileSize, float maxHeight, float spacing)
+{
+    GridSize = gridSize;
+    Spacing = spacing;
+    Tiles.clear();
+    Columns.clear();
+    Runs.clear();
+    TileLods.clear();
+    VisibleTileOrigins.clear();
+    VisibleTiles = 0;
+    OccludedTiles = 0;
+    VisibleInstances = 0;
+
+    if (gridSize <= 0 || tileSize <= 0)
+        return;
+
+    Columns.reserve(gridSize * gridSize);
+    int halfGrid = gridSize / 2;
+
+    for (int tz = 0; tz < gridSize; tz += tileSize)
+    {
+        for (int tx = 0; tx < gridSize; tx += tileSize)
+        {
+            int endX = tx + tileSize < gridSize ? tx + tileSize : gridSize;
+            int endZ = tz + tileSize < gridSize ? tz + tileSize : gridSize;
+
+            Tile tile;
+            tile.first = int(Columns.size());
+            tile.count = (endX - tx) * (endZ - tz);
+            tile.origin = unsigned(tz * gridSize + tx);
+            tile.min = vec3((tx - halfGrid - 0.5f) * spacing, 0.f, (tz - halfGrid - 0.5f) * spacing);
+            tile.max = vec3((endX - 1 - halfGrid + 0.5f) * spacing, maxHeight, (endZ - 1 - halfGrid + 0.5f) * spacing);
+            Tiles.push_back(tile);
+
+            for (int z = tz; z < endZ; ++z)
+                for (int x = tx; x < endX; ++x)
+                    Columns.push_back(unsigned(z * gridSize + x));
+        }
+    }
+
+    TileLods.assign(Tiles.size(), int(LOD_CUBE));
+}
+
+const vector<unsigned int> & GridCuller::getColumns() const
+{
+    return Columns;
+}
+
+int GridCuller::getGridSize() const
+{
+    return GridSize;
+}
+
+void GridCuller::setLodDistances(float topDistance, float pointDistance, float hysteresis)
+{
+    LodDistances[0] = topDistance;
+    LodDistances[1] = pointDistance > topDistance ? pointDistance : topDistance;
+    LodHysteresis = hysteresis;
+}
+
+int GridCuller::cull(const mat4 & viewProjection)
+{
+    return cull(viewProjection, 0, 0);
+}
+
+int GridCuller::cull(const mat4 & viewProjection, const vec3 & eye)
+{
+    return cull(viewProjection, &eye, 0);
+}
+
+int GridCuller::cull(const mat4 & viewProjection, const vec3 & eye, const OcclusionRasterizer * occlusion)
+{
+    return cull(viewProjection, &eye, occlusion);
+}
+
+int GridCuller::cull(const mat4 & viewProjection, const vec3 * eye, const OcclusionRasterizer * occlusion)
+{
+    Runs.clear();
+    VisibleTileOrigins.clear();
+    VisibleTiles = 0;
+    OccludedTiles = 0;
+    VisibleInstances = 0;
+    for (int l = 0; l < LOD_COUNT; ++l)
+        VisibleLodInstances[l] = 0;
+
+    vec4 planes[6];
+    getFrustumPlanes(viewProjection, planes);
+
+    for (unsigned int t = 0; t < Tiles.size(); ++t)
+    {
+        const Tile & tile = Tiles[t];
+
+        // the box is out once its corner furthest along a plane normal is
+        // behind that plane
+        bool visible = true;
+        for (int p = 0; p < 6 && visible; ++p)
+        {
+            vec3 corner(planes[p].x >= 0.f ? tile.max.x : tile.min.x,
+                        planes[p].y >= 0.f ? tile.max.y : tile.min.y,
+                        planes[p].z >= 0.f ? tile.max.z : tile.min.z);
+            visible = dot(vec3(planes[p]), corner) + planes[p].w >= 0.f;
+        }
+
+        if (!visible)
+            continue;
+
+        if (occlusion && occlusion->isOccluded(tile.min, tile.max))
+        {
+            ++OccludedTiles;
+            continue;
+        }
+
+        int lod = LOD_CUBE;
+        if (eye)
+        {
+            // step from the last level, a threshold has to be crossed by the
+            // hysteresis margin before the level changes
+            float distance = length(clamp(*eye, tile.min, tile.max) - *eye);
+            lod = TileLods[t];
+            while (lod < LOD_COUNT - 1 && distance > LodDistances[lod] * (1.f + LodHysteresis))
+                ++lod;
+            while (lod > LOD_CUBE && distance < LodDistances[lod - 1] * (1.f - LodHysteresis))
+                --lod;
+            TileLods[t] = lod;
+        }
+
+        ++VisibleTiles;
+        VisibleInstances += tile.count;
+        VisibleLodInstances[lod] += tile.count;
+        VisibleTileOrigins.push_back(tile.origin);
+        if (!Runs.empty() && Runs.back().lod == lod && Runs.back().first + Runs.back().count == tile.first)
+        {
+            Runs.back().count += tile.count;
+        }
+        else
+        {
+            Run run = { tile.first, tile.count, lod };
+            Runs.push_back(run);
+        }
+    }
+
+    return int(Runs.size());
+}
+
+void GridCuller::addOccluders(OcclusionRasterizer & occlusion, const vec3 & eye, float time, float distance) const
+{
+    if (GridSize <= 0)
+        return;
+
+    // Only columns whose tile is surely drawn as full cubes: past the top
+    // face distance a tile may have no sides, and its columns would hide
+    // what can be seen under their tops
+    distance = std::min(distance, LodDistances[0] * (1.f - LodHysteresis));
+
+    int halfGrid = GridSize / 2;
+    int x0 = std::max(0, int(floor((eye.x - distance) / Spacing + 0.5f)) + halfGrid);
+    int x1 = std::min(GridSize - 1, int(floor((eye.x + distance) / Spacing + 0.5f)) + halfGrid);
+    int z0 = std::max(0, int(floor((eye.z - distance) / Spacing + 0.5f)) + halfGrid);
+    int z1 = std::min(GridSize - 1, int(floor((eye.z + distance) / Spacing + 0.5f)) + halfGrid);
+
+    for (int z = z0; z <= z1; ++z)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            vec2 center((x - halfGrid) * Spacing, (z - halfGrid) * Spacing);
+            if (length(center - vec2(eye.x, eye.z)) > distance)
+                continue;
+
+            // a little lower than the GPU height, so float differences
+            // between both noises never make an occluder too tall
+            float height = ColumnHeights::height(z * GridSize + x, GridSize, time, eye) - 0.01f;
+            if (height <= 0.f)
+                continue;
+            float half = Spacing * 0.5f;
+            vec3 boxMin(center.x - half, 0.f, center.y - half);
+            vec3 boxMax(center.x + half, height, center.y + half);
+            // the tile box holds the column box, so it is at least as close
+            if (length(clamp(eye, boxMin, boxMax) - eye) > distance)
+                continue;
+            occlusion.addOccluder(boxMin, boxMax);
+        }
+    }
+}
+
+const vector<GridCuller::Run> & GridCuller::getRuns() const
+{
+    return Runs;
+}
+
+const vector<unsigned int> & GridCuller::getVisibleTileOrigins() const
+{
+    return VisibleTileOrigins;
+}
+
+// Sums and differences of the matrix rows (Gribb & Hartmann)
+void GridCuller::getFrustumPlanes(const mat4 & viewProjection, vec4 planes[6])
+{
+    mat4 m = transpose(viewProjection);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+}
+
+int GridCuller::getTileCount() const
+{
+    return int(Tiles.size());
+}
+
+int GridCuller::getVisibleTileCount() const
+{
+    return VisibleTiles;
+}
+
+int GridCuller::getVisibleInstanceCount() const
+{
+    return VisibleInstances;
+}
+
+int GridCuller::getOccludedTileCount() const
+{
+    return OccludedTiles;
+}
+
+int GridCuller::getVisibleInstanceCount(int lod) const
+{
+    return lod >= 0 && lod < LOD_COUNT ? VisibleLodInstances[lod] : 0;
+}
@@ -0,0 +1,109 @@
+#ifndef GRID_CULLER_H
+#define GRID_CULLER_H
+
+#include <vector>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+class OcclusionRasterizer;
+
+// Splits the cube grid into square tiles of columns and culls them against
+// the view frustum. Columns are stored tile by tile, so the instances of a
+// tile are contiguous, and visible tiles that follow each other in that
+// order merge into one run, drawn with a single base instance draw call.
+// Each visible tile also gets a level of detail from its distance to the
+// camera, and runs only merge tiles drawn at the same level.
+class GridCuller
+{
+    public:
+        enum Lod
+        {
+            LOD_CUBE = 0,   // the whole cube
+            LOD_TOP,        // top face only
+            LOD_POINT,      // one point per column
+            LOD_COUNT
+        };
+
+        // instances [first, first + count) of the tile-major column list
+        struct Run
+        {
+            int first;
+            int count;
+            int lod;
+        };
+
+        GridCuller();
+
+        // Same layout as cube_grid.vert: column (x, z) spans
+        // [x - gridSize / 2 +- 0.5] * spacing, heights in [0, maxHeight]
+        void build(int gridSize, int tileSize = 32, float maxHeight = 11.f, float spacing = 2.f);
+
+        // column index z * gridSize + x of each instance, tile by tile
+        const vector<unsigned int> & getColumns() const;
+        int getGridSize() const;
+
+        // A tile drops to LOD_TOP past topDistance and to LOD_POINT past
+        // pointDistance, measured from the camera to the closest point of its
+        // box. A tile only changes level once it is hysteresis (a fraction of
+        // the distance) past a threshold, so it does not flicker on the edge.
+        void setLodDistances(float topDistance, float pointDistance, float hysteresis = 0.1f);
+
+        // Keeps the tiles whose box touches the frustum of viewProjection
+        // and returns the number of runs to draw, all at LOD_CUBE
+        int cull(const mat4 & viewProjection);
+        // Same, with levels of detail picked from the camera position eye
+        int cull(const mat4 & viewProjection, const vec3 & eye);
+        // Same, also leaving out the tiles occlusion finds hidden
+        int cull(const mat4 & viewProjection, const vec3 & eye, const OcclusionRasterizer * occlusion);
+
+        // Queues the columns within distance of eye as occluders, with
+        // their height at time from ColumnHeights. distance is cut to where
+        // tiles may drop to LOD_TOP, since top faces hide nothing below.
+        void addOccluders(OcclusionRasterizer & occlusion, const vec3 & eye, float time, float distance) const;
+
+        const vector<Run> & getRuns() const;
+        // first column z * gridSize + x of each tile kept by cull()
+        const vector<unsigned int> & getVisibleTileOrigins() const;
+
+        // Clip planes of viewProjection, a point p is inside when
+        // dot(vec3(plane), p) + plane.w >= 0 for all six
+        static void getFrustumPlanes(const mat4 & viewProjection, vec4 planes[6]);
+
+        int getTileCount() const;
+        int getVisibleTileCount() const;
+        int getVisibleInstanceCount() const;
+        int getVisibleInstanceCount(int lod) const;
+        // tiles in the frustum that occlusion left out at the last cull
+        int getOccludedTileCount() const;
+
+    private:
+        int cull(const mat4 & viewProjection, const vec3 * eye, const OcclusionRasterizer * occlusion);
+
+        struct Tile
+        {
+            vec3 min;
+            vec3 max;
+            int first;
+            int count;
+            unsigned int origin;
+        };
+
+        vector<Tile> Tiles;
+        vector<unsigned int> VisibleTileOrigins;
+        vector<unsigned int> Columns;
+        vector<Run> Runs;
+        // level each tile was drawn at last, for the hysteresis
+        vector<int> TileLods;
+        int GridSize;
+        float Spacing;
+        int VisibleTiles;
+        int OccludedTiles;
+        int VisibleInstances;
+        int VisibleLodInstances[LOD_COUNT];
+        float LodDistances[LOD_COUNT - 1];
+        float LodHysteresis;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// CLUSTERS_NO_SSE keeps the scalar loop, bench/check_lights.cpp builds
+// both to compare them
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(CLUSTERS_NO_SSE)
+#include <emmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+LightClusters::LightClusters(int tilesX, int tilesY, int slices)
+    : TilesX(std::max(tilesX, 1)), TilesY(std::max(tilesY, 1)), Slices(std::max(slices, 1)),
+      RowStride((std::max(tilesX, 1) + 3) & ~3), Projection(0.f), Near(0.f), Far(0.f), SliceScale(0.f), SliceBias(0.f),
+      TanHalfX(0.f), TanHalfY(0.f), MaxClusterLightCount(0)
+{
+    Clusters.assign(getClusterCount() * 2, 0);
+}
+
+void LightClusters::setProjection(const mat4 & projection)
+{
+    if (projection == Projection)
+        return;
+    Projection = projection;
+
+    // glm::perspective() planes and half angles
+    TanHalfX = 1.f / projection[0][0];
+    TanHalfY = 1.f / projection[1][1];
+    Near = projection[3][2] / (projection[2][2] - 1.f);
+    Far = projection[3][2] / (projection[2][2] + 1.f);
+    SliceScale = Slices / std::log(Far / Near);
+    SliceBias = -std::log(Near) * SliceScale;
+
+    SliceDepths.resize(Slices + 1);
+    for (int s = 0; s <= Slices; ++s)
+        SliceDepths[s] = Near * std::pow(Far / Near, float(s) / Slices);
+
+    // A tile spans [ndc0, ndc1] * tanHalf * depth, the box of a cluster
+    // takes the widest of its near and far ends
+    MinX.assign(Slices * RowStride, 1e30f);
+    MaxX.assign(Slices * RowStride, -1e30f);
+    MinY.resize(Slices * TilesY);
+    MaxY.resize(Slices * TilesY);
+    for (int s = 0; s < Slices; ++s)
+    {
+        float d0 = SliceDepths[s];
+        float d1 = SliceDepths[s + 1];
+        for (int x = 0; x < TilesX; ++x)
+        {
+            float ndc0 = -1.f + 2.f * x / TilesX;
+            float ndc1 = -1.f + 2.f * (x + 1) / TilesX;
+            MinX[s * RowStride + x] = std::min(ndc0 * TanHalfX * d0, ndc0 * TanHalfX * d1);
+            MaxX[s * RowStride + x] = std::max(ndc1 * TanHalfX * d0, ndc1 * TanHalfX * d1);
+        }
+        for (int y = 0; y < TilesY; ++y)
+        {
+            float ndc0 = -1.f + 2.f * y / TilesY;
+            float ndc1 = -1.f + 2.f * (y + 1) / TilesY;
+            MinY[s * TilesY + y] = std::min(ndc0 * TanHalfY * d0, ndc0 * TanHalfY * d1);
+            MaxY[s * TilesY + y] = std::max(ndc1 * TanHalfY * d0, ndc1 * TanHalfY * d1);
+        }
+    }
+}
+
+int LightClusters::sliceOf(float depth) const
+{
+    return std::min(Slices - 1, std::max(0, int(std::floor(std::log(depth) * SliceScale + SliceBias))));
+}
+
+void LightClusters::build(const vector<vec4> & viewSpheres)
+{
+    Hits.clear();
+    if (!SliceDepths.empty())
+    {
+        for (unsigned int l = 0; l < viewSpheres.size(); ++l)
+        {
+            vec3 center = vec3(viewSpheres[l]);
+            float radius = viewSpheres[l].w;
+            float depth = -center.z;
+            if (radius <= 0.f || depth + radius < Near || depth - radius > Far)
+                continue;
+
+            // Tiles and slices the sphere can reach: x / depth is monotonic
+            // in depth, so the ends of the depth range bound the tiles
+            float nearest = std::max(depth - radius, Near);
+            float farthest = std::min(depth + radius, Far);
+            float lowX = std::min((center.x - radius) / nearest, (center.x - radius) / farthest) / TanHalfX;
+            float highX = std::max((center.x + radius) / nearest, (center.x + radius) / farthest) / TanHalfX;
+            float lowY = std::min((center.y - radius) / nearest, (center.y - radius) / farthest) / TanHalfY;
+            float highY = std::max((center.y + radius) / nearest, (center.y + radius) / farthest) / TanHalfY;
+            if (lowX > 1.f || highX < -1.f || lowY > 1.f || highY < -1.f)
+                continue;
+            int x0 = std::max(0, int(std::floor((lowX * 0.5f + 0.5f) * TilesX)));
+            int x1 = std::min(TilesX - 1, int(std::floor((highX * 0.5f + 0.5f) * TilesX)));
+            int y0 = std::max(0, int(std::floor((lowY * 0.5f + 0.5f) * TilesY)));
+            int y1 = std::min(TilesY - 1, int(std::floor((highY * 0.5f + 0.5f) * TilesY)));
+            int s0 = sliceOf(nearest);
+            int s1 = sliceOf(farthest);
+
+            // Squared distance from the center to a box adds up per axis,
+            // and the x, y and depth bounds only depend on the tile column,
+            // the tile row and the slice
+            float radius2 = radius * radius;
+            for (int s = s0; s <= s1; ++s)
+            {
+                float dz = std::max(0.f, std::max(SliceDepths[s] - depth, depth - SliceDepths[s + 1]));
+                float dz2 = dz * dz;
+                if (dz2 > radius2)
+                    continue;
+                for (int y = y0; y <= y1; ++y)
+                {
+                    float dy = std::max(0.f, std::max(MinY[s * TilesY + y] - center.y, center.y - MaxY[s * TilesY + y]));
+                    float left = radius2 - dz2 - dy * dy;
+                    if (left < 0.f)
+                        continue;
+                    const float * minX = &MinX[s * RowStride];
+                    const float * maxX = &MaxX[s * RowStride];
+                    unsigned int row = unsigned((s * TilesY + y) * TilesX);
+#if CLUSTERS_SSE
+                    __m128 cx = _mm_set1_ps(center.x);
+                    __m128 limit = _mm_set1_ps(left);
+                    __m128 zero = _mm_setzero_ps();
+                    for (int x = x0 & ~3; x <= x1; x += 4)
+                    {
+                        __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + x), cx), _mm_sub_ps(cx, _mm_loadu_ps(maxX + x))));
+                        int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), limit));
+                        // lanes before x0 or past x1 are outside the reach
+                        mask &= (0xF << std::max(0, x0 - x)) & (0xF >> std::max(0, x + 3 - x1));
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            if (mask & (1 << i))
+                            {
+                                Hits.push_back(row + unsigned(x + i));
+                                Hits.push_back(l);
+                            }
+                        }
+                    }
+#else
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        float dx = std::max(0.f, std::max(minX[x] - center.x, center.x - maxX[x]));
+                        if (dx * dx <= left)
+                        {
+                            Hits.push_back(row + unsigned(x));
+                            Hits.push_back(l);
+                        }
+                    }
+#endif
+                }
+            }
+        }
+    }
+
+    // Counting sort of the pairs by cluster, lights stay in order
+    Clusters.assign(getClusterCount() * 2, 0);
+    for (unsigned int h = 0; h < Hits.size(); h += 2)
+        ++Clusters[Hits[h] * 2 + 1];
+    unsigned int offset = 0;
+    MaxClusterLightCount = 0;
+    for (int c = 0; c < getClusterCount(); ++c)
+    {
+        Clusters[c * 2] = offset;
+        offset += Clusters[c * 2 + 1];
+        MaxClusterLightCount = std::max(MaxClusterLightCount, int(Clusters[c * 2 + 1]));
+        Clusters[c * 2 + 1] = 0;
+    }
+    LightIndices.resize(offset);
+    for (unsigned int h = 0; h < Hits.size(); h += 2)
+    {
+        unsigned int * cluster = &Clusters[Hits[h] * 2];
+        LightIndices[cluster[0] + cluster[1]++] = Hits[h + 1];
+    }
+}
+
+int LightClusters::getTilesX() const
+{
+    return TilesX;
+}
+
+int LightClusters::getTilesY() const
+{
+    return TilesY;
+}
+
+int LightClusters::getSlices() const
+{
+    return Slices;
+}
+
+int LightClusters::getClusterCount() const
+{
+    return TilesX * TilesY * Slices;
+}
+
+float LightClusters::getSliceScale() const
+{
+    return SliceScale;
+}
+
+float LightClusters::getSliceBias() const
+{
+    return SliceBias;
+}
+
+const vector<unsigned int> & LightClusters::getClusters() const
+{
+    return Clusters;
+}
+
+const vector<unsigned int> & LightClusters::getLightIndices() const
+{
+    return LightIndices;
+}
+
+int LightClusters::getMaxClusterLightCount() const
+{
+    return MaxClusterLightCount;
+}
@@ -0,0 +1,72 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <vector>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Point lights binned into clusters, the cells of the view frustum cut in
+// screen tiles and in depth slices spaced exponentially from the near to
+// the far plane. A pixel then only shades the lights of its cluster.
+// A light goes in every cluster whose view space bounding box its sphere
+// touches, tested 4 tiles of a row at a time.
+class LightClusters
+{
+    public:
+        LightClusters(int tilesX = 16, int tilesY = 9, int slices = 24);
+
+        // Bounds of the clusters for a perspective projection, only
+        // computed again when projection changes
+        void setProjection(const mat4 & projection);
+        // Bins the lights, xyz the view space center and w the radius
+        void build(const vector<vec4> & viewSpheres);
+
+        int getTilesX() const;
+        int getTilesY() const;
+        int getSlices() const;
+        int getClusterCount() const;
+        // Slice of view depth d (positive) is floor(log(d) * scale + bias)
+        float getSliceScale() const;
+        float getSliceBias() const;
+
+        // First index in getLightIndices() and light count, per cluster
+        // (slice * tilesY + y) * tilesX + x, tile 0 at the bottom left
+        const vector<unsigned int> & getClusters() const;
+        const vector<unsigned int> & getLightIndices() const;
+        int getMaxClusterLightCount() const;
+
+    private:
+        int sliceOf(float depth) const;
+
+        int TilesX;
+        int TilesY;
+        int Slices;
+        // TilesX rounded up to 4, the padding tiles never get a light
+        int RowStride;
+        mat4 Projection;
+        float Near;
+        float Far;
+        float SliceScale;
+        float SliceBias;
+        float TanHalfX;
+        float TanHalfY;
+
+        // Depth at the start of each slice, Slices + 1 of them
+        vector<float> SliceDepths;
+        // View space x bounds of tile x in slice s at s * RowStride + x,
+        // y bounds of tile y at s * TilesY + y
+        vector<float> MinX;
+        vector<float> MaxX;
+        vector<float> MinY;
+        vector<float> MaxY;
+
+        // cluster, light pairs in light order
+        vector<unsigned int> Hits;
+        vector<unsigned int> Clusters;
+        vector<unsigned int> LightIndices;
+        int MaxClusterLightCount;
+};
+
+#endif
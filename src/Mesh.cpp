@@ -0,0 +1,234 @@
+#include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <cstring>
+#include <gtc/packing.hpp>
+
+Mesh::Mesh()
+    : RestartIndex(0xFFFFFFFFu), Format(VERTEX_FLOAT), IndexType(GL_UNSIGNED_INT), IndexSize(4), VertexStride(0),
+      VertexBuffer(0), IndexBuffer(0)
+{
+}
+
+void Mesh::setData(const float * positions, const float * normals, const float * uvs, int vertexCount,
+                   const unsigned int * indices, int indexCount, unsigned int restartIndex)
+{
+    Positions.assign(positions, positions + vertexCount * 3);
+    Normals.assign(normals, normals + vertexCount * 3);
+    if (uvs)
+        Uvs.assign(uvs, uvs + vertexCount * 2);
+    else
+        Uvs.clear();
+    Indices.assign(indices, indices + indexCount);
+    RestartIndex = restartIndex;
+}
+
+void Mesh::optimize(const vector<int> & splits, vector<unsigned int> * remap)
+{
+    int vertexCount = getVertexCount();
+    bool hasUvs = !Uvs.empty();
+
+    // Every attribute of a vertex side by side, equal vertices have equal bytes
+    int stride = hasUvs ? 8 : 6;
+    vector<float> vertices(vertexCount * stride);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        memcpy(&vertices[v * stride], &Positions[v * 3], 3 * sizeof(float));
+        memcpy(&vertices[v * stride + 3], &Normals[v * 3], 3 * sizeof(float));
+        if (hasUvs)
+            memcpy(&vertices[v * stride + 6], &Uvs[v * 2], 2 * sizeof(float));
+    }
+
+    vector<unsigned int> merged;
+    int uniqueCount = MeshOptimizer::buildDeduplicationRemap(&vertices[0], stride, vertexCount, merged);
+    MeshOptimizer::remapIndices(Indices, merged);
+
+    int first = 0;
+    for (unsigned int s = 0; s <= splits.size(); ++s)
+    {
+        int end = s < splits.size() ? splits[s] : getIndexCount();
+        MeshOptimizer::optimizeVertexCache(Indices, first, end - first, uniqueCount);
+        first = end;
+    }
+
+    vector<unsigned int> fetch;
+    MeshOptimizer::buildFetchRemap(Indices, uniqueCount, fetch);
+    MeshOptimizer::remapIndices(Indices, fetch);
+
+    // Both passes at once for the vertices
+    vector<unsigned int> combined(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        combined[v] = fetch[merged[v]];
+    MeshOptimizer::remapVertices(Positions, 3, combined, uniqueCount);
+    MeshOptimizer::remapVertices(Normals, 3, combined, uniqueCount);
+    MeshOptimizer::remapVertices(Uvs, 2, combined, uniqueCount);
+
+    if (remap)
+        remap->swap(combined);
+}
+
+float Mesh::getAcmr(int cacheSize) const
+{
+    return MeshOptimizer::computeAcmr(Indices, getVertexCount(), cacheSize);
+}
+
+void Mesh::upload(VertexFormat format)
+{
+    Format = format;
+    int vertexCount = getVertexCount();
+    bool hasUvs = !Uvs.empty();
+
+    // The restart index becomes all ones of the index type, so the largest
+    // vertex index has to stay below it
+    IndexType = GL_UNSIGNED_INT;
+    IndexSize = 4;
+    if (format == VERTEX_COMPACT && vertexCount < 0xFF)
+    {
+        IndexType = GL_UNSIGNED_BYTE;
+        IndexSize = 1;
+    }
+    else if (format == VERTEX_COMPACT && vertexCount < 0xFFFF)
+    {
+        IndexType = GL_UNSIGNED_SHORT;
+        IndexSize = 2;
+    }
+
+    // Half positions are padded to 8 bytes so the normal stays aligned
+    if (format == VERTEX_COMPACT)
+        VertexStride = hasUvs ? 16 : 12;
+    else
+        VertexStride = hasUvs ? 32 : 24;
+
+    vector<unsigned char> vertices(vertexCount * VertexStride, 0);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        unsigned char * vertex = &vertices[v * VertexStride];
+        const float * p = &Positions[v * 3];
+        const float * n = &Normals[v * 3];
+        if (format == VERTEX_COMPACT)
+        {
+            unsigned short position[3] = { packHalf1x16(p[0]), packHalf1x16(p[1]), packHalf1x16(p[2]) };
+            GLuint normal = packSnorm3x10_1x2(vec4(n[0], n[1], n[2], 0.f));
+            memcpy(vertex, position, sizeof(position));
+            memcpy(vertex + 8, &normal, sizeof(normal));
+            if (hasUvs)
+            {
+                unsigned short uv[2] = { packHalf1x16(Uvs[v * 2]), packHalf1x16(Uvs[v * 2 + 1]) };
+                memcpy(vertex + 12, uv, sizeof(uv));
+            }
+        }
+        else
+        {
+            memcpy(vertex, p, 3 * sizeof(float));
+            memcpy(vertex + 12, n, 3 * sizeof(float));
+            if (hasUvs)
+                memcpy(vertex + 24, &Uvs[v * 2], 2 * sizeof(float));
+        }
+    }
+
+    GLuint restart = getRestartIndex();
+    vector<unsigned char> indices(Indices.size() * IndexSize);
+    for (unsigned int i = 0; i < Indices.size(); ++i)
+    {
+        GLuint index = Indices[i] == RestartIndex ? restart : Indices[i];
+        if (IndexSize == 1)
+            indices[i] = (unsigned char) index;
+        else if (IndexSize == 2)
+        {
+            unsigned short shortIndex = (unsigned short) index;
+            memcpy(&indices[i * 2], &shortIndex, 2);
+        }
+        else
+            memcpy(&indices[i * 4], &index, 4);
+    }
+
+    if (!VertexBuffer)
+    {
+        glGenBuffers(1, &VertexBuffer);
+        glGenBuffers(1, &IndexBuffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.empty() ? 0 : &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Through the copy target, the vertex array bound now keeps its own
+    // element buffer
+    glBindBuffer(GL_COPY_WRITE_BUFFER, IndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size(), indices.empty() ? 0 : &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Mesh::bindAttributes() const
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if (Format == VERTEX_COMPACT)
+    {
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, VertexStride, (void*)0);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, VertexStride, (void*)8);
+    }
+    else
+    {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VertexStride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VertexStride, (void*)12);
+    }
+
+    if (Uvs.empty())
+    {
+        glDisableVertexAttribArray(2);
+    }
+    else
+    {
+        glEnableVertexAttribArray(2);
+        if (Format == VERTEX_COMPACT)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, VertexStride, (void*)12);
+        else
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VertexStride, (void*)24);
+    }
+}
+
+Mesh::VertexFormat Mesh::getFormat() const
+{
+    return Format;
+}
+
+int Mesh::getVertexCount() const
+{
+    return int(Positions.size() / 3);
+}
+
+int Mesh::getIndexCount() const
+{
+    return int(Indices.size());
+}
+
+GLenum Mesh::getIndexType() const
+{
+    return IndexType;
+}
+
+int Mesh::getIndexSize() const
+{
+    return IndexSize;
+}
+
+GLuint Mesh::getRestartIndex() const
+{
+    return IndexSize == 4 ? 0xFFFFFFFFu : (1u << (IndexSize * 8)) - 1u;
+}
+
+int Mesh::getVertexStride() const
+{
+    return VertexStride;
+}
+
+int Mesh::getVertexBytes() const
+{
+    return getVertexCount() * VertexStride;
+}
+
+int Mesh::getIndexBytes() const
+{
+    return getIndexCount() * IndexSize;
+}
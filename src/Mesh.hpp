@@ -0,0 +1,78 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Vertices and indices of a mesh, packed in one interleaved vertex buffer
+// and one index buffer. The source data stays on the CPU, so the mesh can
+// be packed again in the other format at any time.
+// Attributes go to locations 0 (position), 1 (normal) and 2 (uv), the uv
+// is left out when the mesh has none.
+class Mesh
+{
+    public:
+        enum VertexFormat
+        {
+            // float position, normal and uv, 32-bit indices (32 bytes)
+            VERTEX_FLOAT = 0,
+            // half float position, GL_INT_2_10_10_10_REV normal, half float
+            // uv, and the smallest index type that holds every index (16 bytes)
+            VERTEX_COMPACT
+        };
+
+        Mesh();
+
+        // Copies the mesh; normals and uvs hold 3 and 2 floats per vertex,
+        // uvs may be 0. An index equal to restartIndex restarts the primitive.
+        void setData(const float * positions, const float * normals, const float * uvs, int vertexCount,
+                     const unsigned int * indices, int indexCount, unsigned int restartIndex = 0xFFFFFFFFu);
+
+        // Runs MeshOptimizer over the triangle list: merges equal vertices,
+        // reorders the triangles for the vertex cache, then the vertices in
+        // the order they are first used. splits are index offsets that cut
+        // the list in ranges drawn on their own, no triangle crosses them.
+        // remap receives the new index of each old vertex.
+        void optimize(const vector<int> & splits = vector<int>(), vector<unsigned int> * remap = 0);
+        // Average cache miss ratio of the indices, see MeshOptimizer
+        float getAcmr(int cacheSize = 16) const;
+
+        // Packs the mesh in format into its buffers, created on the first call
+        void upload(VertexFormat format);
+        // Binds the index buffer and points the attributes at the vertex
+        // buffer, in the vertex array bound now
+        void bindAttributes() const;
+
+        VertexFormat getFormat() const;
+        int getVertexCount() const;
+        int getIndexCount() const;
+        // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        GLenum getIndexType() const;
+        int getIndexSize() const;
+        // restartIndex of setData(), in the index type
+        GLuint getRestartIndex() const;
+        int getVertexStride() const;
+        // bytes of vertex and index data of the current format
+        int getVertexBytes() const;
+        int getIndexBytes() const;
+
+    private:
+        vector<float> Positions;
+        vector<float> Normals;
+        vector<float> Uvs;
+        vector<unsigned int> Indices;
+        unsigned int RestartIndex;
+
+        VertexFormat Format;
+        GLenum IndexType;
+        int IndexSize;
+        int VertexStride;
+        GLuint VertexBuffer;
+        GLuint IndexBuffer;
+};
+
+#endif
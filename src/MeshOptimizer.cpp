@@ -0,0 +1,183 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // Orders vertex indices by the bytes of their vertex
+    struct VertexLess
+    {
+        const float * Vertices;
+        int Stride;
+
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return memcmp(Vertices + a * Stride, Vertices + b * Stride, Stride * sizeof(float)) < 0;
+        }
+    };
+}
+
+int MeshOptimizer::buildDeduplicationRemap(const float * vertices, int stride, int vertexCount, vector<unsigned int> & remap)
+{
+    vector<unsigned int> order(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        order[v] = unsigned(v);
+    VertexLess less = { vertices, stride };
+    stable_sort(order.begin(), order.end(), less);
+
+    // The first vertex of each run of equal ones has the lowest index, the
+    // others point at it
+    vector<unsigned int> canonical(vertexCount);
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        bool same = i > 0 && !less(order[i - 1], order[i]);
+        canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+    }
+
+    remap.resize(vertexCount);
+    int uniqueCount = 0;
+    for (int v = 0; v < vertexCount; ++v)
+        remap[v] = canonical[v] == unsigned(v) ? unsigned(uniqueCount++) : remap[canonical[v]];
+    return uniqueCount;
+}
+
+int MeshOptimizer::buildFetchRemap(const vector<unsigned int> & indices, int vertexCount, vector<unsigned int> & remap)
+{
+    const unsigned int unused = 0xFFFFFFFFu;
+    remap.assign(vertexCount, unused);
+    unsigned int next = 0;
+    for (unsigned int i = 0; i < indices.size(); ++i)
+        if (remap[indices[i]] == unused)
+            remap[indices[i]] = next++;
+    for (int v = 0; v < vertexCount; ++v)
+        if (remap[v] == unused)
+            remap[v] = next++;
+    return int(next);
+}
+
+void MeshOptimizer::remapIndices(vector<unsigned int> & indices, const vector<unsigned int> & remap)
+{
+    for (unsigned int i = 0; i < indices.size(); ++i)
+        indices[i] = remap[indices[i]];
+}
+
+void MeshOptimizer::remapVertices(vector<float> & stream, int components, const vector<unsigned int> & remap, int newVertexCount)
+{
+    if (stream.empty())
+        return;
+
+    vector<float> remapped(newVertexCount * components);
+    for (unsigned int v = 0; v < remap.size(); ++v)
+        memcpy(&remapped[remap[v] * components], &stream[v * components], components * sizeof(float));
+    stream.swap(remapped);
+}
+
+void MeshOptimizer::optimizeVertexCache(vector<unsigned int> & indices, int first, int count, int vertexCount, int cacheSize)
+{
+    int triangleCount = count / 3;
+    if (triangleCount < 2)
+        return;
+
+    const unsigned int * source = &indices[first];
+
+    // Triangles around each vertex, and how many of them are left to emit
+    vector<int> live(vertexCount, 0);
+    for (int i = 0; i < triangleCount * 3; ++i)
+        ++live[source[i]];
+    vector<int> offsets(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+    vector<int> adjacency(triangleCount * 3);
+    vector<int> filled(offsets.begin(), offsets.end() - 1);
+    for (int i = 0; i < triangleCount * 3; ++i)
+        adjacency[filled[source[i]]++] = i / 3;
+
+    vector<int> cacheTime(vertexCount, 0);
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> deadEnd;
+    vector<unsigned int> candidates;
+    vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+
+    int timestamp = cacheSize + 1;
+    int cursor = 0;
+    int fanning = int(source[0]);
+
+    while (fanning >= 0)
+    {
+        // Emit every triangle left around the fanning vertex
+        candidates.clear();
+        for (int k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+        {
+            int t = adjacency[k];
+            if (emitted[t])
+                continue;
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = source[t * 3 + c];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (timestamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next, the candidate still in cache once its own triangles are
+        // emitted that entered the cache first
+        fanning = -1;
+        int bestPriority = -1;
+        for (unsigned int c = 0; c < candidates.size(); ++c)
+        {
+            unsigned int v = candidates[c];
+            if (live[v] <= 0)
+                continue;
+            int priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = timestamp - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = int(v);
+            }
+        }
+
+        // Dead end: back up to the last vertex emitted with triangles left,
+        // then to the first one in index order
+        while (fanning < 0 && !deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                fanning = int(v);
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                fanning = cursor;
+            ++cursor;
+        }
+    }
+
+    copy(output.begin(), output.end(), indices.begin() + first);
+}
+
+float MeshOptimizer::computeAcmr(const vector<unsigned int> & indices, int vertexCount, int cacheSize)
+{
+    if (indices.size() < 3)
+        return 0.f;
+
+    // An entry leaves a FIFO cache cacheSize misses after it came in
+    vector<int> entered(vertexCount, -1);
+    int misses = 0;
+    for (unsigned int i = 0; i < indices.size(); ++i)
+    {
+        unsigned int v = indices[i];
+        if (entered[v] < 0 || misses - entered[v] >= cacheSize)
+            entered[v] = misses++;
+    }
+    return float(misses) / float(indices.size() / 3);
+}
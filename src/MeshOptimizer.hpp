@@ -0,0 +1,36 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+
+using namespace std;
+
+// Build time passes over indexed triangle lists. A pass that moves
+// vertices returns a remap, the new index of each old vertex, which
+// remapIndices() and remapVertices() then apply to the mesh.
+class MeshOptimizer
+{
+    public:
+        // Gives vertices whose stride floats are bitwise equal the same new
+        // index, in order of first appearance. Returns the unique count.
+        static int buildDeduplicationRemap(const float * vertices, int stride, int vertexCount, vector<unsigned int> & remap);
+
+        // Numbers vertices in the order the indices first use them, so the
+        // vertex fetch walks memory forward; unused vertices go last
+        static int buildFetchRemap(const vector<unsigned int> & indices, int vertexCount, vector<unsigned int> & remap);
+
+        static void remapIndices(vector<unsigned int> & indices, const vector<unsigned int> & remap);
+        // Moves the components floats of each vertex of stream to its new index
+        static void remapVertices(vector<float> & stream, int components, const vector<unsigned int> & remap, int newVertexCount);
+
+        // Reorders the triangles of indices [first, first + count) for a post
+        // transform cache of cacheSize vertices, with Tipsify (Sander, Nehab
+        // and Barczak 2007). The vertices each triangle uses do not change.
+        static void optimizeVertexCache(vector<unsigned int> & indices, int first, int count, int vertexCount, int cacheSize = 16);
+
+        // Average cache miss ratio: vertices a FIFO cache of cacheSize
+        // transforms per triangle, 0.5 at best on large meshes, 3 at worst
+        static float computeAcmr(const vector<unsigned int> & indices, int vertexCount, int cacheSize = 16);
+};
+
+#endif
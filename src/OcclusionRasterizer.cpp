@@ -0,0 +1,287 @@
+#include "OcclusionRasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height, int threadCount)
+    : Width((std::max(width, 4) + 3) & ~3), Height(std::max(height, 1)), ThreadCount(threadCount),
+      Generation(0), Pending(0), Stopping(false)
+{
+    if (ThreadCount <= 0)
+        ThreadCount = std::max(1, int(thread::hardware_concurrency()));
+    // bands thinner than a few rows cost more to wake than they save
+    ThreadCount = std::min(ThreadCount, std::max(1, Height / 8));
+    Depth.assign(Width * Height, 1.f);
+    for (int i = 1; i < ThreadCount; ++i)
+        Workers.push_back(thread(&OcclusionRasterizer::runBand, this, i));
+}
+
+OcclusionRasterizer::~OcclusionRasterizer()
+{
+    {
+        lock_guard<mutex> lock(Mutex);
+        Stopping = true;
+    }
+    Start.notify_all();
+    for (unsigned int i = 0; i < Workers.size(); ++i)
+        Workers[i].join();
+}
+
+void OcclusionRasterizer::begin(const mat4 & viewProjection, const vec3 & eye)
+{
+    ViewProjection = viewProjection;
+    Eye = eye;
+    Triangles.clear();
+    std::fill(Depth.begin(), Depth.end(), 1.f);
+}
+
+bool OcclusionRasterizer::project(const vec3 & p, vec3 & window) const
+{
+    vec4 clip = ViewProjection * vec4(p, 1.f);
+    if (clip.w <= 0.f || clip.z < -clip.w)
+        return false;
+    vec3 ndc = vec3(clip) / clip.w;
+    window = vec3((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height, ndc.z * 0.5f + 0.5f);
+    return true;
+}
+
+void OcclusionRasterizer::addOccluder(const vec3 & min, const vec3 & max)
+{
+    // corner i has x from bit 0, y from bit 1, z from bit 2
+    vec3 corners[8];
+    for (int i = 0; i < 8; ++i)
+        if (!project(vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z), corners[i]))
+            return;
+
+    // one face per axis at most faces the eye, as a quad of two triangles
+    static const int faces[6][4] = {
+        { 0, 2, 6, 4 }, { 1, 3, 7, 5 },     // x = min, x = max
+        { 0, 1, 5, 4 }, { 2, 3, 7, 6 },     // y = min, y = max
+        { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };   // z = min, z = max
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int face = -1;
+        if (Eye[axis] < min[axis])
+            face = axis * 2;
+        else if (Eye[axis] > max[axis])
+            face = axis * 2 + 1;
+        if (face < 0)
+            continue;
+        const int * q = faces[face];
+        addTriangle(corners[q[0]], corners[q[1]], corners[q[2]]);
+        addTriangle(corners[q[0]], corners[q[2]], corners[q[3]]);
+    }
+}
+
+void OcclusionRasterizer::addTriangle(const vec3 & v0, const vec3 & v1, const vec3 & v2)
+{
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (std::fabs(area) < 1e-6f)
+        return;
+
+    // counter clockwise, so the inside is where all edges are positive
+    const vec3 * v[3] = { &v0, &v1, &v2 };
+    if (area < 0.f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+
+    Triangle t;
+    for (int e = 0; e < 3; ++e)
+    {
+        const vec3 & p = *v[e];
+        const vec3 & q = *v[(e + 1) % 3];
+        t.a[e] = p.y - q.y;
+        t.b[e] = q.x - p.x;
+        // a pixel center has to sit half a pixel inside every edge
+        t.c[e] = -t.a[e] * p.x - t.b[e] * p.y - 0.5f * (std::fabs(t.a[e]) + std::fabs(t.b[e]));
+    }
+
+    // depth plane through the three vertices, raised to its farthest value
+    // over the pixel around each center
+    vec3 d1 = *v[1] - *v[0];
+    vec3 d2 = *v[2] - *v[0];
+    t.dzdx = (d1.z * d2.y - d2.z * d1.y) / area;
+    t.dzdy = (d2.z * d1.x - d1.z * d2.x) / area;
+    t.z0 = v[0]->z - t.dzdx * v[0]->x - t.dzdy * v[0]->y + 0.5f * (std::fabs(t.dzdx) + std::fabs(t.dzdy));
+
+    float minX = std::min(v0.x, std::min(v1.x, v2.x));
+    float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+    float minY = std::min(v0.y, std::min(v1.y, v2.y));
+    float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+    t.minX = std::max(0, int(std::floor(minX)));
+    t.minY = std::max(0, int(std::floor(minY)));
+    t.maxX = std::min(Width - 1, int(std::floor(maxX)));
+    t.maxY = std::min(Height - 1, int(std::floor(maxY)));
+    if (t.minX > t.maxX || t.minY > t.maxY)
+        return;
+
+    Triangles.push_back(t);
+}
+
+void OcclusionRasterizer::rasterize()
+{
+    if (ThreadCount <= 1 || Triangles.empty())
+    {
+        rasterizeRows(0, Height);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(Mutex);
+        Pending = ThreadCount - 1;
+        ++Generation;
+    }
+    Start.notify_all();
+    rasterizeRows(0, Height / ThreadCount);
+
+    unique_lock<mutex> lock(Mutex);
+    Done.wait(lock, [this] { return Pending == 0; });
+}
+
+// The mutex orders the triangles and the depth written before a generation
+// with the band threads drawing it, and their rows with the caller after
+void OcclusionRasterizer::runBand(int band)
+{
+    unsigned int seen = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(Mutex);
+            Start.wait(lock, [this, seen] { return Stopping || Generation != seen; });
+            if (Stopping)
+                return;
+            seen = Generation;
+        }
+
+        rasterizeRows(Height * band / ThreadCount, Height * (band + 1) / ThreadCount);
+
+        lock_guard<mutex> lock(Mutex);
+        if (--Pending == 0)
+            Done.notify_one();
+    }
+}
+
+// Every band walks the whole list and only touches its own rows, so the
+// bands need no locking
+void OcclusionRasterizer::rasterizeRows(int firstRow, int endRow)
+{
+    for (unsigned int i = 0; i < Triangles.size(); ++i)
+    {
+        const Triangle & t = Triangles[i];
+        int y0 = std::max(t.minY, firstRow);
+        int y1 = std::min(t.maxY + 1, endRow);
+        int x0 = t.minX & ~3;
+
+        for (int y = y0; y < y1; ++y)
+        {
+            float cy = y + 0.5f;
+            float * row = &Depth[y * Width];
+#if OCCLUSION_SSE
+            __m128 x = _mm_add_ps(_mm_set1_ps(x0 + 0.5f), _mm_set_ps(3.f, 2.f, 1.f, 0.f));
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[0]), x), _mm_set1_ps(t.b[0] * cy + t.c[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[1]), x), _mm_set1_ps(t.b[1] * cy + t.c[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[2]), x), _mm_set1_ps(t.b[2] * cy + t.c[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.dzdx), x), _mm_set1_ps(t.dzdy * cy + t.z0));
+            __m128 step0 = _mm_set1_ps(t.a[0] * 4.f);
+            __m128 step1 = _mm_set1_ps(t.a[1] * 4.f);
+            __m128 step2 = _mm_set1_ps(t.a[2] * 4.f);
+            __m128 stepZ = _mm_set1_ps(t.dzdx * 4.f);
+            __m128 zero = _mm_setzero_ps();
+
+            for (int px = x0; px <= t.maxX; px += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                __m128 depth = _mm_loadu_ps(row + px);
+                __m128 nearer = _mm_min_ps(depth, z);
+                _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+                e0 = _mm_add_ps(e0, step0);
+                e1 = _mm_add_ps(e1, step1);
+                e2 = _mm_add_ps(e2, step2);
+                z = _mm_add_ps(z, stepZ);
+            }
+#else
+            for (int px = x0; px <= t.maxX; ++px)
+            {
+                float cx = px + 0.5f;
+                if (t.a[0] * cx + t.b[0] * cy + t.c[0] >= 0.f &&
+                    t.a[1] * cx + t.b[1] * cy + t.c[1] >= 0.f &&
+                    t.a[2] * cx + t.b[2] * cy + t.c[2] >= 0.f)
+                    row[px] = std::min(row[px], t.dzdx * cx + t.dzdy * cy + t.z0);
+            }
+#endif
+        }
+    }
+}
+
+bool OcclusionRasterizer::isOccluded(const vec3 & min, const vec3 & max) const
+{
+    vec3 lower(1e30f);
+    vec3 upper(-1e30f);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 window;
+        // a box reaching behind the camera is taken as visible
+        if (!project(vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z), window))
+            return false;
+        lower = glm::min(lower, window);
+        upper = glm::max(upper, window);
+    }
+
+    int x0 = std::max(0, int(std::floor(lower.x)));
+    int y0 = std::max(0, int(std::floor(lower.y)));
+    int x1 = std::min(Width - 1, int(std::floor(upper.x)));
+    int y1 = std::min(Height - 1, int(std::floor(upper.y)));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    // visible as soon as one pixel under the box is at or behind its
+    // nearest depth
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float * row = &Depth[y * Width];
+        int x = x0;
+#if OCCLUSION_SSE
+        __m128 nearest = _mm_set1_ps(lower.z);
+        for (; x + 3 <= x1; x += 4)
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)))
+                return false;
+#endif
+        for (; x <= x1; ++x)
+            if (row[x] >= lower.z)
+                return false;
+    }
+    return true;
+}
+
+int OcclusionRasterizer::getWidth() const
+{
+    return Width;
+}
+
+int OcclusionRasterizer::getHeight() const
+{
+    return Height;
+}
+
+int OcclusionRasterizer::getThreadCount() const
+{
+    return ThreadCount;
+}
+
+int OcclusionRasterizer::getTriangleCount() const
+{
+    return int(Triangles.size());
+}
+
+const vector<float> & OcclusionRasterizer::getDepth() const
+{
+    return Depth;
+}
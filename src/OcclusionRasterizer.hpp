@@ -0,0 +1,90 @@
+#ifndef OCCLUSION_RASTERIZER_H
+#define OCCLUSION_RASTERIZER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Coarse depth buffer drawn on the CPU, for occlusion culling without GL.
+// Occluder boxes are rasterized from the inside: a pixel is only written
+// when the whole pixel lies in a face, with the farthest depth the face has
+// over it, so a box found behind the buffer is hidden for sure. Rows are
+// split in bands, one thread per band, and filled 4 pixels at a time. The
+// band threads start with the rasterizer and wait between frames.
+class OcclusionRasterizer
+{
+    public:
+        // width is rounded up to a multiple of 4, threadCount 0 takes one
+        // thread per hardware thread
+        OcclusionRasterizer(int width = 256, int height = 128, int threadCount = 0);
+        ~OcclusionRasterizer();
+        OcclusionRasterizer(const OcclusionRasterizer &) = delete;
+        OcclusionRasterizer & operator=(const OcclusionRasterizer &) = delete;
+
+        // Clears the buffer, next boxes are seen from eye through viewProjection
+        void begin(const mat4 & viewProjection, const vec3 & eye);
+        // Queues the faces of the box that face the eye. Boxes crossing the
+        // near plane are left out.
+        void addOccluder(const vec3 & min, const vec3 & max);
+        // Draws every queued face into the buffer
+        void rasterize();
+
+        // true when every pixel under the box is nearer than the box
+        bool isOccluded(const vec3 & min, const vec3 & max) const;
+
+        int getWidth() const;
+        int getHeight() const;
+        int getThreadCount() const;
+        int getTriangleCount() const;
+        // row major from the bottom row, window depth in [0, 1]
+        const vector<float> & getDepth() const;
+
+    private:
+        // Edge functions a * x + b * y + c, the pixel is in when all three
+        // are >= 0, and the depth plane, both biased by half a pixel
+        struct Triangle
+        {
+            float a[3];
+            float b[3];
+            float c[3];
+            float dzdx;
+            float dzdy;
+            float z0;
+            int minX;
+            int minY;
+            int maxX;
+            int maxY;
+        };
+
+        // window coordinates of p, false when p is behind the near plane
+        bool project(const vec3 & p, vec3 & window) const;
+        void addTriangle(const vec3 & v0, const vec3 & v1, const vec3 & v2);
+        void rasterizeRows(int firstRow, int endRow);
+        // Body of the thread of band, draws it once per rasterize()
+        void runBand(int band);
+
+        vector<float> Depth;
+        vector<Triangle> Triangles;
+        mat4 ViewProjection;
+        vec3 Eye;
+        int Width;
+        int Height;
+        int ThreadCount;
+
+        // Band 0 is drawn by the caller, bands 1 and up by Workers. A new
+        // Generation starts them, the last one to finish signals Done.
+        vector<thread> Workers;
+        mutex Mutex;
+        condition_variable Start;
+        condition_variable Done;
+        unsigned int Generation;
+        int Pending;
+        bool Stopping;
+};
+
+#endif
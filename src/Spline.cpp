@@ -0,0 +1,110 @@
+#include "Spline.hpp"
+#include "AdaptiveSampler.hpp"
+
+Spline::Spline()
+    : SplineType(CATMULL_ROM), Closed(false)
+{
+}
+
+Spline::Spline(const vector<vec3> & controlPoints, Type type, bool closed)
+    : ControlPoints(controlPoints), SplineType(type), Closed(closed)
+{
+}
+
+void Spline::setControlPoints(const vector<vec3> & controlPoints)
+{
+    ControlPoints = controlPoints;
+}
+
+const vector<vec3> & Spline::getControlPoints() const
+{
+    return ControlPoints;
+}
+
+int Spline::getSegmentCount() const
+{
+    int n = int(ControlPoints.size());
+    if (n < 2)
+        return 0;
+    return Closed ? n : n - 1;
+}
+
+// wrap around on closed curves, repeat the end points on open ones
+const vec3 & Spline::point(int i) const
+{
+    int n = int(ControlPoints.size());
+    if (Closed)
+        return ControlPoints[((i % n) + n) % n];
+    return ControlPoints[i < 0 ? 0 : (i >= n ? n - 1 : i)];
+}
+
+vec3 Spline::evaluateSegment(int segment, float u) const
+{
+    const vec3 & p0 = point(segment - 1);
+    const vec3 & p1 = point(segment);
+    const vec3 & p2 = point(segment + 1);
+    const vec3 & p3 = point(segment + 2);
+
+    float u2 = u * u;
+    float u3 = u2 * u;
+
+    if (SplineType == B_SPLINE)
+    {
+        float v = 1.f - u;
+        return (v * v * v * p0
+                + (3.f * u3 - 6.f * u2 + 4.f) * p1
+                + (-3.f * u3 + 3.f * u2 + 3.f * u + 1.f) * p2
+                + u3 * p3) / 6.f;
+    }
+
+    return 0.5f * ((-u3 + 2.f * u2 - u) * p0
+                   + (3.f * u3 - 5.f * u2 + 2.f) * p1
+                   + (-3.f * u3 + 4.f * u2 + u) * p2
+                   + (u3 - u2) * p3);
+}
+
+vec3 Spline::evaluate(double t) const
+{
+    int segmentCount = getSegmentCount();
+    if (segmentCount == 0)
+        return ControlPoints.empty() ? vec3(0.f) : ControlPoints[0];
+
+    t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+    double position = t * segmentCount;
+    int segment = int(position);
+    if (segment >= segmentCount)
+        segment = segmentCount - 1;
+
+    return evaluateSegment(segment, float(position - segment));
+}
+
+vector<vec3> Spline::Sample(int cpts) const
+{
+    vector<vec3> p(cpts);
+    if (cpts < 2)
+    {
+        if (cpts == 1)
+            p[0] = evaluate(0.0);
+        return p;
+    }
+
+    double step = (double)1.0 / (cpts - 1);
+    for (int i = 0; i < cpts; ++i)
+        p[i] = evaluate(i * step);
+
+    return p;
+}
+
+vector<vec3> Spline::SampleAdaptive(float tolerance, vector<double> * parameters) const
+{
+    vector<vec3> p;
+    if (ControlPoints.empty())
+        return p;
+
+    AdaptiveSampler<Spline> sampler;
+    sampler.setTolerance(tolerance);
+    sampler.setMinSegments(getSegmentCount());
+    sampler.sample(*this, p, parameters);
+
+    return p;
+}
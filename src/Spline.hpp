@@ -0,0 +1,46 @@
+#ifndef SPLINE_H
+#define SPLINE_H
+
+#include <vector>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Piecewise cubic curve over any number of control points. Segments are
+// uniform in t, so finding the one under t is a multiply and each sample
+// only touches four control points.
+class Spline
+{
+    public:
+        enum Type
+        {
+            CATMULL_ROM, // goes through every control point
+            B_SPLINE     // C2 smooth, stays inside the control polygon
+        };
+
+        Spline();
+        Spline(const vector<vec3> & controlPoints, Type type = CATMULL_ROM, bool closed = false);
+
+        void setControlPoints(const vector<vec3> & controlPoints);
+        const vector<vec3> & getControlPoints() const;
+        int getSegmentCount() const;
+
+        // t in [0, 1] over the whole curve
+        vec3 evaluate(double t) const;
+        vector<vec3> Sample(int cpts) const;
+        // Fewer points where the curve is straight, none of the polyline
+        // strays more than tolerance from the curve. parameters receives
+        // the t of each point when given.
+        vector<vec3> SampleAdaptive(float tolerance, vector<double> * parameters = 0) const;
+
+    private:
+        const vec3 & point(int i) const;
+        vec3 evaluateSegment(int segment, float u) const;
+
+        vector<vec3> ControlPoints;
+        Type SplineType;
+        bool Closed;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "WaypointGenerator.hpp"
+
+WaypointGenerator::WaypointGenerator(unsigned int seed, int gridSize)
+    : Random(seed), HalfGrid(gridSize * 0.5f), MinDistance(0.f), MinHeight(1.f), MaxHeight(16.f)
+{
+}
+
+void WaypointGenerator::setMinDistance(float distance)
+{
+    MinDistance = distance;
+}
+
+void WaypointGenerator::setHeightRange(float minHeight, float maxHeight)
+{
+    MinHeight = minHeight;
+    MaxHeight = maxHeight;
+}
+
+double WaypointGenerator::nextUnit()
+{
+    return Random() * (1.0 / 4294967296.0);
+}
+
+// uniform over [-HalfGrid, previous - distance] U [previous + distance, HalfGrid]
+float WaypointGenerator::nextAway(float previous, float distance)
+{
+    float below = previous - distance + HalfGrid;
+    float above = HalfGrid - previous - distance;
+    below = below > 0.f ? below : 0.f;
+    above = above > 0.f ? above : 0.f;
+
+    float r = float(nextUnit() * (below + above));
+    if (r < below)
+        return -HalfGrid + r;
+    return previous + distance + (r - below);
+}
+
+void WaypointGenerator::generate(vector<vec3> & path, int count)
+{
+    float distance = MinDistance < 0.9f * HalfGrid ? MinDistance : 0.9f * HalfGrid;
+
+    path.reserve(path.size() + count);
+    for (int i = 0; i < count; ++i)
+    {
+        vec3 newPos;
+        newPos.x = float(-HalfGrid + nextUnit() * 2.0 * HalfGrid);
+        newPos.y = float(MinHeight + nextUnit() * (MaxHeight - MinHeight));
+        newPos.z = float(-HalfGrid + nextUnit() * 2.0 * HalfGrid);
+
+        // one axis alone carries the whole distance to the previous point
+        if (!path.empty())
+        {
+            const vec3 & previous = path.back();
+            if (nextUnit() < 0.5)
+                newPos.x = nextAway(previous.x, distance);
+            else
+                newPos.z = nextAway(previous.z, distance);
+        }
+
+        path.push_back(newPos);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef WAYPOINT_GENERATOR_H
+#define WAYPOINT_GENERATOR_H
+
+#include <random>
+#include <vector>
+#include <glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Camera waypoints over the grid, reproducible from a seed. Each point
+// is drawn directly from the region far enough from the previous one, so
+// generation is O(n) with no retry loop.
+class WaypointGenerator
+{
+    public:
+        WaypointGenerator(unsigned int seed, int gridSize);
+
+        // wanted distance between consecutive waypoints, kept below half
+        // the grid so the allowed region is never empty
+        void setMinDistance(float distance);
+        void setHeightRange(float minHeight, float maxHeight);
+
+        // append count waypoints, the first one far from path.back()
+        void generate(vector<vec3> & path, int count);
+
+    private:
+        // uniform in [0, 1), from the raw engine output so the sequence is
+        // the same with every standard library
+        double nextUnit();
+        float nextAway(float previous, float distance);
+
+        mt19937 Random;
+        float HalfGrid;
+        float MinDistance;
+        float MinHeight;
+        float MaxHeight;
+};
+
+#endif